@@ -0,0 +1,21 @@
+#!/bin/sh
+# Run every test in benchmark mode (SVM_CL_BENCH, default 10 repetitions)
+# and print the timings grouped by backing type. SVM_CL_KERNEL picks the
+# access pattern for the whole run.
+base=`dirname $0`
+cd $base
+PATH=$PATH:./
+export SVM_CL_BENCH=${SVM_CL_BENCH:-10}
+tests=`find . -maxdepth 1 -type f -executable -name 'test-*'`
+for i in $tests ; do
+    $base/run.sh `basename $i`
+done | grep '^BENCH' | sort -k3,3 -k2,2 | awk '
+BEGIN {
+    printf "%-14s %-24s %10s %10s %10s %10s %9s %10s %10s\n", "backing",
+           "test", "nwords", "min ms", "med ms", "max ms", "GB/s",
+           "kernel ms", "readbk ms"
+}
+{
+    printf "%-14s %-24s %10s %10s %10s %10s %9s %10s %10s\n", $3, $2, $5,
+           $9, $11, $13, $15, $18, $20
+}'
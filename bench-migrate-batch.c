@@ -0,0 +1,180 @@
+/*
+ * Copyright 2018 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Batched vs. one call per range migration: for 1 to 1024 discontiguous
+ * ranges (each followed by a gap of its own size) of 4KiB, 64KiB and 2MiB,
+ * migrate them to the device with one cl_program_migrate_ranges_async()
+ * call, and with one cl_program_migrate_async() call per range, waiting
+ * with clFinish() at the end either way. Everything is migrated back to
+ * the host, in one untimed call, before each timed run. Reports median
+ * wall time, per range cost and the batching speedup; range count and
+ * size combinations that need more than the maximum size are skipped.
+ *
+ * Usage: bench-migrate-batch [max size, default 256M]
+ *                            [repetitions, default 16]
+ */
+#include "helpers.h"
+
+#define MAX_SIZE    (256UL << 20)
+#define REPS        16
+
+static const unsigned counts[] = { 1, 4, 16, 64, 256, 1024 };
+static const size_t sizes[] = { 4UL << 10, 64UL << 10, 2UL << 20 };
+
+static int migrate_back(struct cl_program *clprog, struct cl_range *ranges,
+                        unsigned n)
+{
+    if (cl_program_migrate_ranges_async(clprog, ranges, n,
+                                        CL_MIGRATE_MEM_OBJECT_HOST, 0, NULL,
+                                        NULL)) {
+        return -1;
+    }
+    return clFinish(clprog->queue) == CL_SUCCESS ? 0 : -1;
+}
+
+static int migrate_batched(struct cl_program *clprog,
+                           struct cl_range *ranges, unsigned n, uint64_t *ns)
+{
+    uint64_t t;
+
+    t = time_ns();
+    if (cl_program_migrate_ranges_async(clprog, ranges, n, 0, 0, NULL,
+                                        NULL) ||
+        clFinish(clprog->queue) != CL_SUCCESS) {
+        return -1;
+    }
+    *ns = time_ns() - t;
+    return 0;
+}
+
+static int migrate_single(struct cl_program *clprog,
+                          struct cl_range *ranges, unsigned n, uint64_t *ns)
+{
+    unsigned i;
+    uint64_t t;
+
+    t = time_ns();
+    for (i = 0; i < n; ++i) {
+        if (cl_program_migrate_async(clprog, ranges[i].ptr, ranges[i].size,
+                                     0, 0, NULL, NULL)) {
+            clFinish(clprog->queue);
+            return -1;
+        }
+    }
+    if (clFinish(clprog->queue) != CL_SUCCESS) {
+        return -1;
+    }
+    *ns = time_ns() - t;
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    uint64_t *batched = NULL, *single = NULL;
+    struct bench_stats batched_stats, single_stats;
+    struct cl_range *ranges = NULL;
+    enum status status = SUCCESS;
+    size_t max_size = MAX_SIZE;
+    struct cl_program clprog;
+    unsigned c, s, i, n, reps = REPS;
+    char *append = "\n";
+    char *map = NULL;
+    int res;
+
+    if (argc > 1)
+        max_size = ALIGN(parse_size(argv[1]), 1UL << 12);
+    if (argc > 2)
+        reps = strtoul(argv[2], NULL, 0);
+    if (!max_size || !reps) {
+        append = "invalid arguments\n";
+        status = ERROR;
+        goto out;
+    }
+
+    batched = malloc(reps * sizeof(*batched));
+    single = malloc(reps * sizeof(*single));
+    ranges = malloc(counts[sizeof(counts) / sizeof(counts[0]) - 1] *
+                    sizeof(*ranges));
+    if (batched == NULL || single == NULL || ranges == NULL) {
+        append = "allocating samples failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    map = mem_anon_map(max_size);
+    if (map == NULL) {
+        append = "mapping anon failed\n";
+        status = ERROR;
+        goto out;
+    }
+    /* Populate, migrations should move pages and not allocate them. */
+    memset(map, 0, max_size);
+
+    res = cl_program_init(&clprog, 1 << 10);
+    if (res) {
+        append = "cl program init failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    printf("times in us\n");
+    printf("%6s %9s %10s %10s %11s %11s %8s\n", "ranges", "size",
+           "batched", "single", "batched/rg", "single/rg", "speedup");
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        for (c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {
+            n = counts[c];
+            if (2 * n * sizes[s] > max_size) {
+                continue;
+            }
+            for (i = 0; i < n; ++i) {
+                ranges[i].ptr = map + 2 * i * sizes[s];
+                ranges[i].size = sizes[s];
+            }
+            for (i = 0; i < reps; ++i) {
+                if (migrate_back(&clprog, ranges, n) ||
+                    migrate_batched(&clprog, ranges, n, &batched[i]) ||
+                    migrate_back(&clprog, ranges, n) ||
+                    migrate_single(&clprog, ranges, n, &single[i])) {
+                    append = "migrating memory failed\n";
+                    status = ERROR;
+                    goto out;
+                }
+            }
+            bench_stats_compute(batched, reps, &batched_stats);
+            bench_stats_compute(single, reps, &single_stats);
+            printf("%6u %9zu %10.1f %10.1f %11.2f %11.2f %7.2fx\n", n,
+                   sizes[s], batched_stats.median / 1e3,
+                   single_stats.median / 1e3,
+                   batched_stats.median / 1e3 / n,
+                   single_stats.median / 1e3 / n,
+                   (double)single_stats.median / batched_stats.median);
+        }
+    }
+
+    if (verify_zero(map, max_size / sizeof(int), NULL)) {
+        append = "memory changed by migrations\n";
+        status = ERROR;
+    }
+
+out:
+    if (map) {
+        mem_unmap(map, max_size);
+    }
+    free(ranges);
+    free(batched);
+    free(single);
+    print_status(status, argv, append);
+    return 0;
+}
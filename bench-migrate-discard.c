@@ -0,0 +1,135 @@
+/*
+ * Copyright 2018 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Content-preserving vs. discard migration of an output: fill r with its
+ * initial pattern as the write tests do, migrate it to the device with
+ * cl_program_migrate() or cl_program_migrate_discard(), then run the kernel
+ * that overwrites it, once backed by 4KiB pages (MADV_NOHUGEPAGE) and once
+ * by THP (2MiB aligned, MADV_HUGEPAGE). Every repetition uses a fresh
+ * mapping. Reports the median migrate, kernel and migrate plus kernel
+ * times, migrate GB/s and the speedup of discarding. A driver that ignores
+ * CL_MIGRATE_MEM_OBJECT_CONTENT_UNDEFINED shows no speedup; every run is
+ * checked either way.
+ *
+ * Usage: bench-migrate-discard [nwords, default 16M] [repetitions, default 16]
+ */
+#include "helpers.h"
+
+#define NWORDS      (1UL << 24)
+#define REPS        16
+#define TWOMEG      (1UL << 21)
+
+static int migrate_run(struct cl_program *clprog, int thp, int discard,
+                       uint64_t *migrate, uint64_t *kernel)
+{
+    size_t size = ALIGN(clprog->nwords * sizeof(int), TWOMEG);
+    char *map_orig, *map;
+    uint64_t t;
+    int ret = -1;
+
+    map_orig = mem_anon_map_advise(size + TWOMEG,
+                                   thp ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+    if (map_orig == NULL) {
+        return -1;
+    }
+    map = (char *)ALIGN((uintptr_t)map_orig, TWOMEG);
+    cl_program_fill(clprog, map, CL_ARG_R);
+
+    t = time_ns();
+    if (discard ? cl_program_migrate_discard(clprog, map) :
+                  cl_program_migrate(clprog, map)) {
+        goto out;
+    }
+    *migrate = time_ns() - t;
+
+    if (cl_program_run(clprog, NULL, NULL, map)) {
+        goto out;
+    }
+    *kernel = clprog->kernel_ns;
+    ret = 0;
+out:
+    mem_unmap(map_orig, size + TWOMEG);
+    return ret;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t nwords = parse_nwords(argc, argv, NWORDS);
+    struct bench_stats migrate, kernel, total;
+    enum status status = SUCCESS;
+    uint64_t *samples = NULL;
+    struct cl_program clprog;
+    unsigned i, reps = REPS;
+    double preserve_total = 0;
+    char *append = "\n";
+    int res, thp, discard;
+
+    if (argc > 2)
+        reps = strtoul(argv[2], NULL, 0);
+    if (!reps) {
+        append = "invalid arguments\n";
+        status = ERROR;
+        goto out;
+    }
+
+    samples = malloc(3 * reps * sizeof(*samples));
+    if (samples == NULL) {
+        append = "allocating samples failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    res = cl_program_init(&clprog, nwords);
+    if (res) {
+        append = "cl program init failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    printf("%zu bytes, %u repetitions, times in ms\n",
+           nwords * sizeof(int), reps);
+    printf("%-4s %-8s %10s %10s %10s %8s %8s\n", "page", "migrate",
+           "migrate", "kernel", "total", "GB/s", "speedup");
+    for (thp = 0; thp <= 1; ++thp) {
+        for (discard = 0; discard <= 1; ++discard) {
+            for (i = 0; i < reps; ++i) {
+                if (migrate_run(&clprog, thp, discard, &samples[i],
+                                &samples[reps + i])) {
+                    append = "migrate and run failed\n";
+                    status = ERROR;
+                    goto out;
+                }
+                samples[2 * reps + i] = samples[i] + samples[reps + i];
+            }
+            bench_stats_compute(samples, reps, &migrate);
+            bench_stats_compute(samples + reps, reps, &kernel);
+            bench_stats_compute(samples + 2 * reps, reps, &total);
+            if (!discard) {
+                preserve_total = total.median;
+            }
+            printf("%-4s %-8s %10.3f %10.3f %10.3f %8.3f %7.2fx\n",
+                   thp ? "thp" : "4k", discard ? "discard" : "preserve",
+                   migrate.median / 1e6, kernel.median / 1e6,
+                   total.median / 1e6,
+                   (double)nwords * sizeof(int) / migrate.median,
+                   preserve_total / total.median);
+        }
+    }
+
+out:
+    free(samples);
+    print_status(status, argv, append);
+    return 0;
+}
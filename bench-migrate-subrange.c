@@ -0,0 +1,359 @@
+/*
+ * Copyright 2018 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Randomized sub-range migration, the general case of test-malloc-vram-plus:
+ * each round maps a fresh range of 4KiB pages, THP or hugetlbfs pages,
+ * fills it, then migrates one random range of every shape to the device:
+ *   aligned     whole huge pages (4KiB pages for the 4k backing)
+ *   pages       4KiB aligned, any number of pages, cutting huge pages
+ *   partial     4KiB aligned inside a single 2MiB page, splits a THP
+ *   unaligned   any byte offset and length inside the range
+ *   straddle-lo starts in the guard below the range, ends inside it
+ *   straddle-hi starts inside the range, ends in the guard above it
+ *   outside     entirely inside one of the guards
+ * The guards are PROT_NONE mappings next to the range, so nothing else is
+ * ever migrated; without room for them the last three shapes are skipped.
+ * A migration the driver refuses is counted, not fatal. After each round
+ * the kernel reads the whole range and both its result and the range are
+ * checked. Reports per shape latency percentiles and GB/s.
+ *
+ * Usage: bench-migrate-subrange [nwords, default 16M] [rounds, default 32]
+ *                               [seed, default 1]
+ */
+#include "helpers.h"
+
+#define NWORDS      (1UL << 24)
+#define ROUNDS      32
+#define TWOMEG      (1UL << 21)
+#define GUARD       TWOMEG
+#define MAX_PAGES   4096
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+enum backing {
+    BACKING_4K,
+    BACKING_THP,
+    BACKING_HUGETLBFS,
+    NBACKINGS,
+};
+
+static const char *backing_names[NBACKINGS] = {
+    [BACKING_4K] = "4k",
+    [BACKING_THP] = "thp",
+    [BACKING_HUGETLBFS] = "hugetlbfs",
+};
+
+enum shape {
+    SHAPE_ALIGNED,
+    SHAPE_PAGES,
+    SHAPE_PARTIAL,
+    SHAPE_UNALIGNED,
+    SHAPE_STRADDLE_LO,
+    SHAPE_STRADDLE_HI,
+    SHAPE_OUTSIDE,
+    NSHAPES,
+};
+
+static const char *shape_names[NSHAPES] = {
+    [SHAPE_ALIGNED] = "aligned",
+    [SHAPE_PAGES] = "pages",
+    [SHAPE_PARTIAL] = "partial",
+    [SHAPE_UNALIGNED] = "unaligned",
+    [SHAPE_STRADDLE_LO] = "straddle-lo",
+    [SHAPE_STRADDLE_HI] = "straddle-hi",
+    [SHAPE_OUTSIDE] = "outside",
+};
+
+struct shape_stats {
+    uint64_t *samples;
+    uint64_t bytes;
+    uint64_t ns;
+    unsigned n;
+    unsigned refused;
+};
+
+/* xorshift64, seeded from the command line so a run can be replayed. */
+static uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static size_t random_below(uint64_t *state, size_t n)
+{
+    return n ? next_random(state) % n : 0;
+}
+
+/* Random range of the given shape in [map - GUARD, map + size + GUARD). */
+static void shape_range(enum shape shape, char *map, size_t size,
+                        size_t page, uint64_t *state, struct cl_range *range)
+{
+    size_t npages = size >> 12, start, len, huge;
+
+    switch (shape) {
+    case SHAPE_ALIGNED:
+        huge = size / page;
+        start = random_below(state, huge);
+        len = 1 + random_below(state, huge - start < 8 ? huge - start : 8);
+        range->ptr = map + start * page;
+        range->size = len * page;
+        break;
+    case SHAPE_PAGES:
+        start = random_below(state, npages);
+        len = npages - start < MAX_PAGES ? npages - start : MAX_PAGES;
+        range->ptr = map + (start << 12);
+        range->size = (1 + random_below(state, len)) << 12;
+        break;
+    case SHAPE_PARTIAL:
+        /* Leave out at least one 4KiB page of the 2MiB one. */
+        start = random_below(state, size / TWOMEG) * TWOMEG;
+        len = 1 + random_below(state, (TWOMEG >> 12) - 1);
+        start += random_below(state, (TWOMEG >> 12) - len + 1) << 12;
+        range->ptr = map + start;
+        range->size = len << 12;
+        break;
+    case SHAPE_UNALIGNED:
+        start = random_below(state, size);
+        len = size - start < (MAX_PAGES << 12) ? size - start :
+                                                 (MAX_PAGES << 12);
+        range->ptr = map + start;
+        range->size = 1 + random_below(state, len);
+        break;
+    case SHAPE_STRADDLE_LO:
+        start = 1 + random_below(state, GUARD);
+        range->ptr = map - start;
+        range->size = start + 1 + random_below(state, size < GUARD ?
+                                                      size : GUARD);
+        break;
+    case SHAPE_STRADDLE_HI:
+        start = random_below(state, size < GUARD ? size : GUARD);
+        range->ptr = map + size - 1 - start;
+        range->size = start + 1 + 1 + random_below(state, GUARD);
+        break;
+    default:
+        start = random_below(state, GUARD);
+        len = 1 + random_below(state, GUARD - start);
+        range->ptr = (next_random(state) & 1 ? map - GUARD : map + size) +
+                     start;
+        range->size = len;
+        break;
+    }
+}
+
+/* PROT_NONE guards on both sides of [map, map + size), -1 if no room. */
+static int guards_map(char *map, size_t size)
+{
+    void *lo, *hi;
+
+    lo = mmap(map - GUARD, GUARD, PROT_NONE,
+              MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if (lo == MAP_FAILED) {
+        return -1;
+    }
+    hi = mmap(map + size, GUARD, PROT_NONE,
+              MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    /* Kernels before 4.17 take the address as a hint only. */
+    if (lo != map - GUARD || hi != map + size) {
+        munmap(lo, GUARD);
+        if (hi != MAP_FAILED) {
+            munmap(hi, GUARD);
+        }
+        return -1;
+    }
+    return 0;
+}
+
+static void guards_unmap(char *map, size_t size)
+{
+    munmap(map - GUARD, GUARD);
+    munmap(map + size, GUARD);
+}
+
+static char *backing_map(enum backing backing, size_t size)
+{
+    char *orig, *map;
+
+    if (backing == BACKING_HUGETLBFS) {
+        return hugefs_alloc(size);
+    }
+    /* 2MiB aligned either way, with room for the guards around it. */
+    orig = mem_anon_map_advise(size + 3 * TWOMEG,
+                               backing == BACKING_THP ? MADV_HUGEPAGE :
+                                                        MADV_NOHUGEPAGE);
+    if (orig == NULL) {
+        return NULL;
+    }
+    map = (char *)ALIGN((uintptr_t)orig + TWOMEG, TWOMEG);
+    /* Free the room around it for the guards. */
+    munmap(orig, map - orig);
+    munmap(map + size, orig + size + 3 * TWOMEG - (map + size));
+    return map;
+}
+
+static void backing_unmap(enum backing backing, char *map, size_t size)
+{
+    if (backing == BACKING_HUGETLBFS) {
+        hugefs_free(map);
+    } else {
+        mem_unmap(map, size);
+    }
+}
+
+static int run_backing(struct cl_program *clprog, enum backing backing,
+                       unsigned rounds, uint64_t seed,
+                       struct shape_stats *stats)
+{
+    size_t size = ALIGN(clprog->nwords * sizeof(int), TWOMEG);
+    size_t page = backing == BACKING_4K ? 1UL << 12 : TWOMEG;
+    struct bench_stats lat;
+    struct cl_range range;
+    enum shape shape;
+    uint64_t state = seed, t;
+    unsigned i, nshapes;
+    cl_event event;
+    int guards, bad;
+    char *map;
+
+    for (shape = 0; shape < NSHAPES; ++shape) {
+        stats[shape].bytes = stats[shape].ns = 0;
+        stats[shape].n = stats[shape].refused = 0;
+    }
+
+    for (i = 0; i < rounds; ++i) {
+        map = backing_map(backing, size);
+        if (map == NULL) {
+            return 1;
+        }
+        guards = !guards_map(map, size);
+        nshapes = guards ? NSHAPES : SHAPE_STRADDLE_LO;
+        cl_program_fill(clprog, map, CL_ARG_A);
+
+        for (shape = 0; shape < nshapes; ++shape) {
+            shape_range(shape, map, size, page, &state, &range);
+            t = time_ns();
+            if (cl_program_migrate_async(clprog, range.ptr, range.size, 0,
+                                         0, NULL, &event)) {
+                stats[shape].refused++;
+                continue;
+            }
+            if (clWaitForEvents(1, &event) != CL_SUCCESS) {
+                stats[shape].refused++;
+                clReleaseEvent(event);
+                continue;
+            }
+            t = time_ns() - t;
+            clReleaseEvent(event);
+            stats[shape].samples[stats[shape].n++] = t;
+            stats[shape].bytes += range.size;
+            stats[shape].ns += t;
+        }
+
+        /* Whatever moved, the contents must not have changed. */
+        bad = cl_program_run(clprog, map, NULL, NULL) ||
+              verify_linear(map, clprog->nwords, 0, 1, NULL);
+        if (guards) {
+            guards_unmap(map, size);
+        }
+        backing_unmap(backing, map, size);
+        if (bad) {
+            return -1;
+        }
+    }
+
+    for (shape = 0; shape < NSHAPES; ++shape) {
+        printf("%-9s %-11s %6u %7u ", backing_names[backing],
+               shape_names[shape], stats[shape].n, stats[shape].refused);
+        if (!stats[shape].n) {
+            printf("%10s\n", "-");
+            continue;
+        }
+        bench_stats_compute(stats[shape].samples, stats[shape].n, &lat);
+        printf("%10.1f %10.1f %10.1f %10.1f %8.3f\n",
+               stats[shape].bytes / 1024.0 / stats[shape].n,
+               lat.median / 1e3, lat.p99 / 1e3, lat.max / 1e3,
+               (double)stats[shape].bytes / stats[shape].ns);
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t nwords = parse_nwords(argc, argv, NWORDS);
+    struct shape_stats stats[NSHAPES];
+    enum status status = SUCCESS;
+    struct cl_program clprog;
+    unsigned rounds = ROUNDS;
+    enum backing backing;
+    uint64_t seed = 1;
+    char *append = "\n";
+    enum shape shape;
+    int res;
+
+    memset(stats, 0, sizeof(stats));
+    if (argc > 2)
+        rounds = strtoul(argv[2], NULL, 0);
+    if (argc > 3)
+        seed = strtoull(argv[3], NULL, 0);
+    if (!rounds || !seed) {
+        append = "invalid arguments\n";
+        status = ERROR;
+        goto out;
+    }
+
+    for (shape = 0; shape < NSHAPES; ++shape) {
+        stats[shape].samples = malloc(rounds * sizeof(uint64_t));
+        if (stats[shape].samples == NULL) {
+            append = "allocating samples failed\n";
+            status = ERROR;
+            goto out;
+        }
+    }
+
+    /* Whole 2MiB pages, so every backing covers the same range. */
+    nwords = ALIGN(nwords * sizeof(int), TWOMEG) / sizeof(int);
+    res = cl_program_init(&clprog, nwords);
+    if (res) {
+        append = "cl program init failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    printf("%zu bytes, %u rounds, seed %llu, latencies in us\n",
+           nwords * sizeof(int), rounds, (unsigned long long)seed);
+    printf("%-9s %-11s %6s %7s %10s %10s %10s %10s %8s\n", "backing",
+           "shape", "count", "refused", "avg KiB", "p50", "p99", "max",
+           "GB/s");
+    for (backing = 0; backing < NBACKINGS; ++backing) {
+        res = run_backing(&clprog, backing, rounds, seed, stats);
+        if (res > 0) {
+            printf("%-9s %s\n", backing_names[backing], "unavailable");
+        } else if (res) {
+            append = "compare after migrations failed\n";
+            status = ERROR;
+            goto out;
+        }
+    }
+
+out:
+    for (shape = 0; shape < NSHAPES; ++shape) {
+        free(stats[shape].samples);
+    }
+    print_status(status, argv, append);
+    return 0;
+}
@@ -0,0 +1,186 @@
+/*
+ * Copyright 2018 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Migration latency sweep: migrate ranges from 4KiB up to the maximum size
+ * to the device and back to the host, and report latency percentiles from
+ * the queue profiling timestamps and from the host wall clock, plus the
+ * migration rate in pages per second (from the device median). The range
+ * is anonymous memory unless another backing is named, the shmem ones
+ * (share, memfd, memfd-hugetlb, tmpfs-huge) take a different migration
+ * path in the kernel.
+ *
+ * Usage: bench-migrate [max size, default 1G] [repetitions, default 32]
+ *                      [backing, default anon]
+ */
+#include "helpers.h"
+
+#define MIN_SIZE    (1UL << 12)
+#define MAX_SIZE    (1UL << 30)
+#define REPS        32
+
+static void hugefs_unmap(void *ptr, size_t size)
+{
+    hugefs_free(ptr);
+}
+
+static const struct backing {
+    const char *name;
+    void *(*map)(size_t size);
+    void (*unmap)(void *ptr, size_t size);
+} backings[] = {
+    { "anon", mem_anon_map, mem_unmap },
+    { "share", mem_share_map, mem_unmap },
+    { "memfd", mem_memfd_map, mem_unmap },
+    { "memfd-hugetlb", mem_memfd_hugetlb_map, mem_memfd_hugetlb_unmap },
+    { "tmpfs-huge", mem_tmpfs_huge_map, mem_unmap },
+    { "hugetlbfs", hugefs_alloc, hugefs_unmap },
+};
+
+static int migrate_once(cl_command_queue queue, void *ptr, size_t size,
+                        cl_mem_migration_flags flags,
+                        uint64_t *dev, uint64_t *host)
+{
+    const void *ptrs[1];
+    cl_event event;
+    uint64_t t;
+    cl_int res;
+
+    ptrs[0] = ptr;
+    t = time_ns();
+    res = clEnqueueSVMMigrateMem(queue, 1, ptrs, &size, flags,
+                                 0, NULL, &event);
+    if (res != CL_SUCCESS) {
+        return -1;
+    }
+    res = clWaitForEvents(1, &event);
+    *host = time_ns() - t;
+    /* Not every driver fills in the timestamps, fall back to wall time. */
+    if (cl_event_elapsed(event, dev)) {
+        *dev = *host;
+    }
+    clReleaseEvent(event);
+
+    return res == CL_SUCCESS ? 0 : -1;
+}
+
+static void report(const char *dir, size_t size, unsigned reps,
+                   uint64_t *dev_samples, uint64_t *host_samples)
+{
+    struct bench_stats dev, host;
+
+    bench_stats_compute(dev_samples, reps, &dev);
+    bench_stats_compute(host_samples, reps, &host);
+    printf("%-7s %11zu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f %12.0f\n",
+           dir, size, dev.median / 1e3, dev.p90 / 1e3, dev.p99 / 1e3,
+           dev.max / 1e3, host.median / 1e3, host.p99 / 1e3,
+           (size >> 12) / (dev.median / 1e9));
+}
+
+int main(int argc, char* argv[])
+{
+    cl_queue_properties props[] = {
+        CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0
+    };
+    uint64_t *to_dev, *to_dev_host, *to_host, *to_host_host;
+    enum status status = SUCCESS;
+    size_t size, max_size = MAX_SIZE;
+    cl_command_queue queue = NULL;
+    const struct backing *backing = &backings[0];
+    struct cl_program clprog;
+    unsigned i, reps = REPS;
+    char *append = "\n";
+    void *map;
+    cl_int cl_res;
+    int res;
+
+    if (argc > 1)
+        max_size = ALIGN(parse_size(argv[1]), MIN_SIZE);
+    if (argc > 2)
+        reps = strtoul(argv[2], NULL, 0);
+    if (argc > 3) {
+        for (i = 0; i < sizeof(backings) / sizeof(backings[0]); ++i) {
+            if (!strcmp(argv[3], backings[i].name)) {
+                break;
+            }
+        }
+        backing = i < sizeof(backings) / sizeof(backings[0]) ?
+                  &backings[i] : NULL;
+    }
+    if (max_size < MIN_SIZE || !reps || backing == NULL) {
+        append = "invalid arguments\n";
+        status = ERROR;
+        goto out;
+    }
+
+    to_dev = malloc(reps * sizeof(uint64_t));
+    to_dev_host = malloc(reps * sizeof(uint64_t));
+    to_host = malloc(reps * sizeof(uint64_t));
+    to_host_host = malloc(reps * sizeof(uint64_t));
+    if (!to_dev || !to_dev_host || !to_host || !to_host_host) {
+        append = "allocating samples failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    map = backing->map(max_size);
+    if (map == NULL) {
+        append = "mapping failed\n";
+        status = ERROR;
+        goto out;
+    }
+    /* Populate, the first migration should not allocate the pages. */
+    memset(map, 0x5a, max_size);
+
+    res = cl_program_init(&clprog, 1 << 10);
+    if (res) {
+        append = "cl program init failed\n";
+        status = ERROR;
+        goto out;
+    }
+    queue = clCreateCommandQueueWithProperties(clprog.context,
+                                               clprog.device_id,
+                                               props, &cl_res);
+    if (cl_res != CL_SUCCESS) {
+        append = "creating profiling queue failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    printf("%s, latencies in us\n", backing->name);
+    printf("%-7s %11s %10s %10s %10s %10s %10s %10s %12s\n", "dir", "bytes",
+           "dev p50", "dev p90", "dev p99", "dev max", "host p50",
+           "host p99", "pages/s");
+    for (size = MIN_SIZE; size <= max_size; size <<= 1) {
+        for (i = 0; i < reps; ++i) {
+            if (migrate_once(queue, map, size, 0,
+                             &to_dev[i], &to_dev_host[i]) ||
+                migrate_once(queue, map, size, CL_MIGRATE_MEM_OBJECT_HOST,
+                             &to_host[i], &to_host_host[i])) {
+                append = "migrating memory failed\n";
+                status = ERROR;
+                goto out;
+            }
+        }
+        report("to-dev", size, reps, to_dev, to_dev_host);
+        report("to-host", size, reps, to_host, to_host_host);
+    }
+
+    clReleaseCommandQueue(queue);
+    backing->unmap(map, max_size);
+
+out:
+    print_status(status, argv, append);
+    return 0;
+}
@@ -0,0 +1,203 @@
+/*
+ * Copyright 2018 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * SVM throughput by source NUMA node: for each online node, and interleaved
+ * over all of them, bind a fresh anonymous range to it and populate it, then
+ * time migrating it to the device, migrating it back to system memory (the
+ * pages come back per the binding) and running the kernel on it straight from
+ * system memory. The node local to the device's PCIe root (the first DRM
+ * device's, see numa_device_node()) is marked with a *, and the distance
+ * column is the SLIT distance from it. Medians over the repetitions, GB/s of
+ * range size for the migrations and of the two reads for the kernel. Runs,
+ * with one row, on single node machines.
+ *
+ * Usage: bench-numa [nwords, default 64M] [repetitions, default 5]
+ */
+#include "helpers.h"
+
+#define NWORDS      (1UL << 26)
+#define REPS        5
+
+enum sample {
+    SAMPLE_TO_DEVICE,
+    SAMPLE_TO_HOST,
+    SAMPLE_KERNEL,
+    NSAMPLES,
+};
+
+static int migrate_wait(struct cl_program *clprog, void *ptr, size_t size,
+                        cl_mem_migration_flags flags, uint64_t *ns)
+{
+    cl_event event;
+    uint64_t t;
+    cl_int res;
+
+    t = time_ns();
+    if (cl_program_migrate_async(clprog, ptr, size, flags, 0, NULL, &event)) {
+        return -1;
+    }
+    res = clWaitForEvents(1, &event);
+    *ns = time_ns() - t;
+    clReleaseEvent(event);
+    return res == CL_SUCCESS ? 0 : -1;
+}
+
+/* One repetition on a fresh range, -1 if mapping with placement failed. */
+static int run_once(struct cl_program *clprog, uint64_t *samples,
+                    unsigned reps, int *node)
+{
+    size_t size = clprog->nwords * sizeof(int);
+    void *map;
+    int ret = -2;
+
+    map = mem_anon_map(size);
+    if (map == NULL) {
+        return -1;
+    }
+    memset(map, 0, size);
+    *node = numa_page_node(map);
+
+    if (migrate_wait(clprog, map, size, 0,
+                     &samples[SAMPLE_TO_DEVICE * reps])) {
+        goto out;
+    }
+    if (migrate_wait(clprog, map, size, CL_MIGRATE_MEM_OBJECT_HOST,
+                     &samples[SAMPLE_TO_HOST * reps])) {
+        goto out;
+    }
+    if (cl_program_run(clprog, map, map, NULL)) {
+        goto out;
+    }
+    samples[SAMPLE_KERNEL * reps] = clprog->kernel_ns;
+    ret = verify_zero(map, clprog->nwords, NULL) ? -2 : 0;
+out:
+    mem_unmap(map, size);
+    return ret;
+}
+
+static double gbps(uint64_t *samples, unsigned reps, size_t bytes)
+{
+    struct bench_stats stats;
+
+    bench_stats_compute(samples, reps, &stats);
+    return stats.median ? (double)bytes / stats.median : 0.0;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t nwords = parse_nwords(argc, argv, NWORDS), size;
+    unsigned long online = numa_nodes_online();
+    struct numa_placement placement;
+    enum status status = SUCCESS;
+    int res, node, page_node, device_node, nnodes;
+    struct cl_program clprog;
+    unsigned i, reps = REPS;
+    uint64_t *samples = NULL;
+    char *append = "\n";
+    char label[32];
+
+    if (argc > 2)
+        reps = strtoul(argv[2], NULL, 0);
+    if (!reps) {
+        append = "invalid arguments\n";
+        status = ERROR;
+        goto out;
+    }
+
+    samples = malloc(NSAMPLES * reps * sizeof(*samples));
+    if (samples == NULL) {
+        append = "allocating samples failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    res = cl_program_init(&clprog, nwords);
+    if (res) {
+        append = "cl program init failed\n";
+        status = ERROR;
+        goto out;
+    }
+    size = nwords * sizeof(int);
+
+    nnodes = __builtin_popcountl(online);
+    device_node = numa_device_node();
+    printf("%d NUMA node%s, device node ", nnodes, nnodes > 1 ? "s" : "");
+    if (device_node >= 0) {
+        printf("%d", device_node);
+    } else {
+        printf("unknown");
+    }
+    printf(", %zu bytes, medians in GB/s\n", size);
+    printf("%-16s %5s %8s %10s %10s %10s\n", "placement", "node",
+           "distance", "to device", "to host", "kernel");
+
+    /* Every node on its own, then interleaved when there is more than one. */
+    for (node = 0; node <= (int)NUMA_MAX_NODES; ++node) {
+        if (node == (int)NUMA_MAX_NODES) {
+            if (nnodes < 2) {
+                break;
+            }
+            placement.policy = NUMA_INTERLEAVE;
+            placement.nodes = online;
+            snprintf(label, sizeof(label), "interleave");
+        } else if (online & (1UL << node)) {
+            placement.policy = NUMA_BIND;
+            placement.nodes = 1UL << node;
+            snprintf(label, sizeof(label), "bind:%d%s", node,
+                     node == device_node ? " *" : "");
+        } else {
+            continue;
+        }
+        mem_numa_set(&placement);
+
+        for (i = 0; i < reps; ++i) {
+            res = run_once(&clprog, samples + i, reps, &page_node);
+            if (res) {
+                break;
+            }
+        }
+        if (res == -1) {
+            /* No mbind in this kernel or container, report and go on. */
+            printf("%-16s %5s\n", label, "failed");
+            continue;
+        } else if (res) {
+            append = "numa run failed\n";
+            status = ERROR;
+            goto out;
+        }
+
+        printf("%-16s ", label);
+        if (page_node >= 0) {
+            printf("%5d ", page_node);
+        } else {
+            printf("%5s ", "-");
+        }
+        if (placement.policy == NUMA_BIND && device_node >= 0 &&
+            numa_distance(device_node, node) >= 0) {
+            printf("%8d ", numa_distance(device_node, node));
+        } else {
+            printf("%8s ", "-");
+        }
+        printf("%10.2f %10.2f %10.2f\n",
+               gbps(samples + SAMPLE_TO_DEVICE * reps, reps, size),
+               gbps(samples + SAMPLE_TO_HOST * reps, reps, size),
+               gbps(samples + SAMPLE_KERNEL * reps, reps, 2 * size));
+    }
+
+out:
+    free(samples);
+    print_status(status, argv, append);
+    return 0;
+}
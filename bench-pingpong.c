@@ -0,0 +1,139 @@
+/*
+ * Copyright 2018 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Device/host ping-pong: bounce a populated range between system memory and
+ * the device K times with explicit migrations both ways (0, then
+ * CL_MIGRATE_MEM_OBJECT_HOST), once backed by 4KiB pages (MADV_NOHUGEPAGE)
+ * and once by THP (2MiB aligned, MADV_HUGEPAGE). Reports the median time of
+ * each direction and of a round trip, round trips per second and GB/s
+ * moved (both directions). The range is zero and must still be at the end.
+ *
+ * Usage: bench-pingpong [nwords, default 16M] [round trips, default 32]
+ */
+#include "helpers.h"
+
+#define NWORDS      (1UL << 24)
+#define TRIPS       32
+#define TWOMEG      (1UL << 21)
+
+static int migrate_wait(struct cl_program *clprog, void *ptr, size_t size,
+                        cl_mem_migration_flags flags, uint64_t *ns)
+{
+    cl_event event;
+    uint64_t t;
+    cl_int res;
+
+    t = time_ns();
+    if (cl_program_migrate_async(clprog, ptr, size, flags, 0, NULL, &event)) {
+        return -1;
+    }
+    res = clWaitForEvents(1, &event);
+    *ns = time_ns() - t;
+    clReleaseEvent(event);
+    return res == CL_SUCCESS ? 0 : -1;
+}
+
+static int pingpong(struct cl_program *clprog, int thp, unsigned trips,
+                    uint64_t *samples)
+{
+    size_t size = ALIGN(clprog->nwords * sizeof(int), TWOMEG);
+    uint64_t *to_dev = samples, *to_host = samples + trips;
+    uint64_t *round = samples + 2 * trips;
+    struct bench_stats dev, host, rt;
+    char *map_orig, *map;
+    unsigned i;
+    int ret = -1;
+
+    map_orig = mem_anon_map_advise(size + TWOMEG,
+                                   thp ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+    if (map_orig == NULL) {
+        return -1;
+    }
+    map = (char *)ALIGN((uintptr_t)map_orig, TWOMEG);
+    memset(map, 0, size);
+
+    for (i = 0; i < trips; ++i) {
+        if (migrate_wait(clprog, map, size, 0, &to_dev[i]) ||
+            migrate_wait(clprog, map, size, CL_MIGRATE_MEM_OBJECT_HOST,
+                         &to_host[i])) {
+            goto out;
+        }
+        round[i] = to_dev[i] + to_host[i];
+    }
+    if (verify_zero(map, size / sizeof(int), NULL)) {
+        goto out;
+    }
+
+    bench_stats_compute(to_dev, trips, &dev);
+    bench_stats_compute(to_host, trips, &host);
+    bench_stats_compute(round, trips, &rt);
+    printf("%-4s %12zu %6u %10.1f %10.1f %10.1f %10.1f %8.3f\n",
+           thp ? "thp" : "4k", size, trips, dev.median / 1e3,
+           host.median / 1e3, rt.median / 1e3, 1e9 / rt.median,
+           2.0 * size / rt.median);
+    ret = 0;
+out:
+    mem_unmap(map_orig, size + TWOMEG);
+    return ret;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t nwords = parse_nwords(argc, argv, NWORDS);
+    enum status status = SUCCESS;
+    struct cl_program clprog;
+    unsigned trips = TRIPS;
+    uint64_t *samples = NULL;
+    char *append = "\n";
+    int res, thp;
+
+    if (argc > 2)
+        trips = strtoul(argv[2], NULL, 0);
+    if (!trips) {
+        append = "invalid arguments\n";
+        status = ERROR;
+        goto out;
+    }
+
+    samples = malloc(3 * trips * sizeof(*samples));
+    if (samples == NULL) {
+        append = "allocating samples failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    res = cl_program_init(&clprog, nwords);
+    if (res) {
+        append = "cl program init failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    printf("times in us\n");
+    printf("%-4s %12s %6s %10s %10s %10s %10s %8s\n", "page", "bytes",
+           "trips", "to-dev", "to-host", "round", "trips/s", "GB/s");
+    for (thp = 0; thp <= 1; ++thp) {
+        if (pingpong(&clprog, thp, trips, samples)) {
+            append = "ping-pong failed\n";
+            status = ERROR;
+            goto out;
+        }
+    }
+
+out:
+    free(samples);
+    print_status(status, argv, append);
+    return 0;
+}
@@ -0,0 +1,202 @@
+/*
+ * Copyright 2018 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Pipelined throughput: iterations of migrate to device -> kernel -> migrate
+ * back to host -> kernel on an anonymous range. First with a host wait after
+ * every step, like the blocking helpers do, then chained through event wait
+ * lists with a single wait at the end.
+ *
+ * Usage: bench-pipeline [nwords, default 1M] [iterations, default 64]
+ */
+#include "helpers.h"
+
+#define NWORDS  (1 << 20)
+#define ITERS   64
+
+static int step_wait(cl_event event)
+{
+    cl_int res = clWaitForEvents(1, &event);
+
+    clReleaseEvent(event);
+    return res == CL_SUCCESS ? 0 : -1;
+}
+
+static int run_sync(struct cl_program *clprog, void *a, void *r,
+                    unsigned iters)
+{
+    size_t size = clprog->nwords * sizeof(int);
+    cl_event event;
+    unsigned i;
+
+    for (i = 0; i < iters; ++i) {
+        if (cl_program_migrate_async(clprog, a, size, 0, 0, NULL, &event) ||
+            step_wait(event)) {
+            return -1;
+        }
+        if (cl_program_enqueue(clprog, a, NULL, r, 0, NULL, &event) ||
+            step_wait(event)) {
+            return -1;
+        }
+        if (cl_program_migrate_async(clprog, a, size,
+                                     CL_MIGRATE_MEM_OBJECT_HOST,
+                                     0, NULL, &event) ||
+            step_wait(event)) {
+            return -1;
+        }
+        if (cl_program_enqueue(clprog, a, NULL, r, 0, NULL, &event) ||
+            step_wait(event)) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Each step waits on the previous one, only the host waits on the last. */
+static int run_chained(struct cl_program *clprog, void *a, void *r,
+                       unsigned iters)
+{
+    size_t size = clprog->nwords * sizeof(int);
+    cl_event last, event;
+    unsigned i;
+
+    /* Start the chain on a marker, so both variants do the same work. */
+    if (clEnqueueMarkerWithWaitList(clprog->queue, 0, NULL, &last) !=
+        CL_SUCCESS) {
+        return -1;
+    }
+    for (i = 0; i < iters; ++i) {
+        if (cl_program_migrate_async(clprog, a, size, 0, 1, &last, &event)) {
+            goto error;
+        }
+        clReleaseEvent(last);
+        last = event;
+        if (cl_program_enqueue(clprog, a, NULL, r, 1, &last, &event)) {
+            goto error;
+        }
+        clReleaseEvent(last);
+        last = event;
+        if (cl_program_migrate_async(clprog, a, size,
+                                     CL_MIGRATE_MEM_OBJECT_HOST,
+                                     1, &last, &event)) {
+            goto error;
+        }
+        clReleaseEvent(last);
+        last = event;
+        if (cl_program_enqueue(clprog, a, NULL, r, 1, &last, &event)) {
+            goto error;
+        }
+        clReleaseEvent(last);
+        last = event;
+    }
+
+    return step_wait(last);
+
+error:
+    step_wait(last);
+    return -1;
+}
+
+/* Check the output and refill it for the next variant. */
+static int check(struct cl_program *clprog, int *r)
+{
+    if (cl_program_verify(clprog, r, NULL)) {
+        return -1;
+    }
+    cl_program_fill(clprog, r, CL_ARG_R);
+    return 0;
+}
+
+static void report(const char *name, struct cl_program *clprog,
+                   unsigned iters, uint64_t ns)
+{
+    /* Two migrations and two kernels reading 2 and writing 1 word each. */
+    double bytes = 8.0 * iters * clprog->nwords * sizeof(int);
+
+    printf("%-8s %8u iterations %10.3f ms %10.1f iter/s %8.3f GB/s\n",
+           name, iters, ns / 1e6, iters / (ns / 1e9), bytes / ns);
+}
+
+int main(int argc, char* argv[])
+{
+    enum status status = SUCCESS;
+    size_t nwords = parse_nwords(argc, argv, NWORDS);
+    unsigned iters = ITERS;
+    uint64_t t, sync_ns, chained_ns;
+    struct cl_program clprog;
+    char *append = "\n";
+    void *a, *r;
+    int res;
+
+    if (argc > 2)
+        iters = strtoul(argv[2], NULL, 0);
+
+    a = mem_anon_map(nwords * sizeof(int));
+    r = mem_anon_map(nwords * sizeof(int));
+    if (a == NULL || r == NULL) {
+        append = "mapping anon failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    res = cl_program_init(&clprog, nwords);
+    if (res) {
+        append = "cl program init failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    cl_program_fill(&clprog, a, CL_ARG_A);
+    cl_program_fill(&clprog, r, CL_ARG_R);
+
+    t = time_ns();
+    res = run_sync(&clprog, a, r, iters);
+    sync_ns = time_ns() - t;
+    if (res) {
+        append = "synchronous run failed\n";
+        status = ERROR;
+        goto out;
+    }
+    if (check(&clprog, r)) {
+        append = "synchronous result check failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    t = time_ns();
+    res = run_chained(&clprog, a, r, iters);
+    chained_ns = time_ns() - t;
+    if (res) {
+        append = "chained run failed\n";
+        status = ERROR;
+        goto out;
+    }
+    if (check(&clprog, r)) {
+        append = "chained result check failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    report("sync", &clprog, iters, sync_ns);
+    report("chained", &clprog, iters, chained_ns);
+    printf("chained speedup %.2fx\n", (double)sync_ns / chained_ns);
+
+    mem_unmap(r, nwords * sizeof(int));
+    mem_unmap(a, nwords * sizeof(int));
+
+out:
+    print_status(status, argv, append);
+    return 0;
+}
@@ -0,0 +1,164 @@
+/*
+ * Copyright 2018 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Steady state vs. first fault: run the kernel over and over on a region,
+ * either a fresh mapping every iteration (what the tests do) or one
+ * recycled through a mem_pool with each reset policy, left in host memory
+ * or made device resident again on put. The kernel reads the region as a
+ * and b, or writes it as r. Reports the first kernel time, the steady
+ * state (iterations after the first) kernel p50/p99 and the time put takes
+ * to reset and migrate the region. Regions stay zero throughout, so every
+ * run is checked.
+ *
+ * Usage: bench-pool [nwords, default 16M] [iterations, default 32]
+ */
+#include "helpers.h"
+
+#define NWORDS      (1UL << 24)
+#define ITERS       32
+
+static const char *reset_names[MEM_POOL_NRESETS] = {
+    [MEM_POOL_KEEP] = "keep",
+    [MEM_POOL_DONTNEED] = "dontneed",
+    [MEM_POOL_ZERO] = "zero",
+};
+
+/*
+ * -1 reset means no pool, map and unmap every iteration. Returns 1 if the
+ * backing is not available (no hugetlbfs pool, or no MADV_DONTNEED on it),
+ * -1 if a run or migration fails.
+ */
+static int run_mode(struct cl_program *clprog, int huge, int reset,
+                    int resident, int write, unsigned iters,
+                    uint64_t *kernel, uint64_t *put)
+{
+    size_t size = clprog->nwords * sizeof(int);
+    struct mem_pool pool;
+    unsigned i;
+    uint64_t t;
+    void *ptr;
+    int ret = -1;
+
+    mem_pool_init(&pool, size, huge, reset < 0 ? MEM_POOL_KEEP : reset,
+                  resident ? clprog : NULL);
+    for (i = 0; i < iters; ++i) {
+        ptr = mem_pool_get(&pool);
+        if (ptr == NULL) {
+            ret = 1;
+            goto out;
+        }
+        if (cl_program_run(clprog, write ? NULL : ptr, write ? NULL : ptr,
+                           write ? ptr : NULL)) {
+            mem_pool_unmap(&pool, ptr);
+            goto out;
+        }
+        kernel[i] = clprog->kernel_ns;
+        t = time_ns();
+        if (reset < 0) {
+            mem_pool_unmap(&pool, ptr);
+        } else {
+            ret = mem_pool_put(&pool, ptr);
+            if (ret) {
+                goto out;
+            }
+        }
+        put[i] = time_ns() - t;
+    }
+    ret = 0;
+out:
+    mem_pool_fini(&pool);
+    return ret;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t nwords = parse_nwords(argc, argv, NWORDS);
+    uint64_t *kernel = NULL, *put = NULL;
+    enum status status = SUCCESS;
+    struct bench_stats steady, reset_stats;
+    int res, huge, reset, resident, write;
+    struct cl_program clprog;
+    unsigned iters = ITERS;
+    char *append = "\n";
+
+    if (argc > 2)
+        iters = strtoul(argv[2], NULL, 0);
+    if (iters < 2) {
+        append = "invalid arguments\n";
+        status = ERROR;
+        goto out;
+    }
+
+    kernel = malloc(iters * sizeof(*kernel));
+    put = malloc(iters * sizeof(*put));
+    if (kernel == NULL || put == NULL) {
+        append = "allocating samples failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    res = cl_program_init(&clprog, nwords);
+    if (res) {
+        append = "cl program init failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    printf("%zu bytes, %u iterations, times in ms\n",
+           nwords * sizeof(int), iters);
+    printf("%-9s %-6s %-9s %-8s %10s %10s %10s %10s\n", "backing", "access",
+           "reset", "resident", "first", "steady p50", "steady p99",
+           "put p50");
+    for (huge = 0; huge <= 1; ++huge) {
+        for (write = 0; write <= 1; ++write) {
+            for (reset = -1; reset < MEM_POOL_NRESETS; ++reset) {
+                for (resident = 0; resident <= 1; ++resident) {
+                    /* A fresh mapping has nothing to keep resident. */
+                    if (reset < 0 && resident) {
+                        continue;
+                    }
+                    res = run_mode(&clprog, huge, reset, resident, write,
+                                   iters, kernel, put);
+                    printf("%-9s %-6s %-9s %-8s ",
+                           huge ? "hugetlbfs" : "anon",
+                           write ? "write" : "read",
+                           reset < 0 ? "fresh" : reset_names[reset],
+                           resident ? "device" : "host");
+                    if (res < 0) {
+                        printf("%10s\n", "failed");
+                        append = "cl program run failed\n";
+                        status = ERROR;
+                        goto out;
+                    }
+                    if (res) {
+                        printf("%10s\n", "unsupported");
+                        continue;
+                    }
+                    bench_stats_compute(kernel + 1, iters - 1, &steady);
+                    bench_stats_compute(put, iters, &reset_stats);
+                    printf("%10.3f %10.3f %10.3f %10.3f\n", kernel[0] / 1e6,
+                           steady.median / 1e6, steady.p99 / 1e6,
+                           reset_stats.median / 1e6);
+                }
+            }
+        }
+    }
+
+out:
+    free(kernel);
+    free(put);
+    print_status(status, argv, append);
+    return 0;
+}
@@ -0,0 +1,148 @@
+/*
+ * Copyright 2018 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Cold vs. pre-populated first GPU access: for each populate mode of the
+ * allocators (see mem_populate_set()), map a fresh anonymous range, then
+ * time the first kernel reading it (a = b = map) and, on another fresh
+ * range, the first kernel writing it (r = map), followed by a second warm
+ * run. The map column is what populating costs on the host, first - warm
+ * is what GPU faults cost, so map + first is the number to compare with
+ * "none". Medians over the repetitions.
+ *
+ * Usage: bench-populate [nwords, default 64M] [repetitions, default 5]
+ */
+#include "helpers.h"
+
+#define NWORDS      (1UL << 26)
+#define REPS        5
+
+struct sample {
+    uint64_t map;
+    uint64_t first;
+    uint64_t warm;
+};
+
+/*
+ * Map with mode and run twice, read: kernel reads the range, else writes.
+ * Returns 1 if the mode cannot map (older kernels or RLIMIT_MEMLOCK), -1 if
+ * a run fails.
+ */
+static int first_access(struct cl_program *clprog, int read,
+                        struct sample *sample)
+{
+    size_t size = clprog->nwords * sizeof(int);
+    uint64_t t;
+    void *map;
+    int ret = -1;
+
+    t = time_ns();
+    map = mem_anon_map(size);
+    sample->map = time_ns() - t;
+    if (map == NULL) {
+        return 1;
+    }
+
+    if (cl_program_run(clprog, read ? map : NULL, read ? map : NULL,
+                       read ? NULL : map)) {
+        goto out;
+    }
+    sample->first = clprog->kernel_ns;
+    if (cl_program_run(clprog, read ? map : NULL, read ? map : NULL,
+                       read ? NULL : map)) {
+        goto out;
+    }
+    sample->warm = clprog->kernel_ns;
+    ret = 0;
+out:
+    mem_unmap(map, size);
+    return ret;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t nwords = parse_nwords(argc, argv, NWORDS);
+    enum status status = SUCCESS;
+    struct bench_stats map, first, warm;
+    uint64_t *samples = NULL;
+    struct cl_program clprog;
+    struct sample sample;
+    enum mem_populate mode;
+    unsigned i, reps = REPS;
+    char *append = "\n";
+    int res, read;
+
+    if (argc > 2)
+        reps = strtoul(argv[2], NULL, 0);
+    if (!reps) {
+        append = "invalid arguments\n";
+        status = ERROR;
+        goto out;
+    }
+
+    samples = malloc(3 * reps * sizeof(*samples));
+    if (samples == NULL) {
+        append = "allocating samples failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    res = cl_program_init(&clprog, nwords);
+    if (res) {
+        append = "cl program init failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    printf("%zu bytes, medians in ms\n", nwords * sizeof(int));
+    printf("%-15s %-6s %10s %10s %10s %12s\n", "populate", "access",
+           "map", "first", "warm", "map + first");
+    for (mode = 0; mode < MEM_NPOPULATE; ++mode) {
+        mem_populate_set(mode);
+        for (read = 1; read >= 0; --read) {
+            for (i = 0; i < reps; ++i) {
+                res = first_access(&clprog, read, &sample);
+                if (res < 0) {
+                    append = "cl program run failed\n";
+                    status = ERROR;
+                    goto out;
+                }
+                if (res) {
+                    break;
+                }
+                samples[i] = sample.map;
+                samples[reps + i] = sample.first;
+                samples[2 * reps + i] = sample.warm;
+            }
+            if (i < reps) {
+                /* Older kernels or RLIMIT_MEMLOCK, report and go on. */
+                printf("%-15s %-6s %10s\n", mem_populate_names[mode],
+                       read ? "read" : "write", "unsupported");
+                continue;
+            }
+            bench_stats_compute(samples, reps, &map);
+            bench_stats_compute(samples + reps, reps, &first);
+            bench_stats_compute(samples + 2 * reps, reps, &warm);
+            printf("%-15s %-6s %10.3f %10.3f %10.3f %12.3f\n",
+                   mem_populate_names[mode], read ? "read" : "write",
+                   map.median / 1e6, first.median / 1e6, warm.median / 1e6,
+                   (map.median + first.median) / 1e6);
+        }
+    }
+
+out:
+    free(samples);
+    print_status(status, argv, append);
+    return 0;
+}
@@ -0,0 +1,325 @@
+/*
+ * Copyright 2018 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * The same kernel and size under the four OpenCL memory models, end to end
+ * as an application would use them: the host writes a and b, the kernel
+ * runs, the host checks r.
+ *   system        mem_anon_map() memory passed as is (fine-grain system SVM)
+ *   coarse-grain  clSVMAlloc(), host access between clEnqueueSVMMap() and
+ *                 clEnqueueSVMUnmap()
+ *   fine-grain    clSVMAlloc(CL_MEM_SVM_FINE_GRAIN_BUFFER), no map needed
+ *   cl_mem        host arrays staged with clEnqueueWriteBuffer() and
+ *                 clEnqueueReadBuffer()
+ * Each iteration is split into fill (host writes plus map/unmap or upload),
+ * kernel, readback (map or download of r) and check (verify plus unmap).
+ * Reports the first iteration and medians of the rest, and GB/s of the
+ * three arrays over the median total. Models the device does not report in
+ * CL_DEVICE_SVM_CAPABILITIES are skipped.
+ *
+ * Usage: bench-svm-models [nwords, default 16M] [iterations, default 16]
+ */
+#include "helpers.h"
+
+#define NWORDS      (1UL << 24)
+#define ITERS       16
+
+enum model {
+    MODEL_SYSTEM,
+    MODEL_COARSE,
+    MODEL_FINE,
+    MODEL_BUFFER,
+    NMODELS,
+};
+
+static const char *model_names[NMODELS] = {
+    [MODEL_SYSTEM] = "system",
+    [MODEL_COARSE] = "coarse-grain",
+    [MODEL_FINE] = "fine-grain",
+    [MODEL_BUFFER] = "cl_mem",
+};
+
+static const cl_device_svm_capabilities model_caps[NMODELS] = {
+    [MODEL_SYSTEM] = CL_DEVICE_SVM_FINE_GRAIN_SYSTEM,
+    [MODEL_COARSE] = CL_DEVICE_SVM_COARSE_GRAIN_BUFFER,
+    [MODEL_FINE] = CL_DEVICE_SVM_FINE_GRAIN_BUFFER,
+    [MODEL_BUFFER] = 0,
+};
+
+enum phase {
+    PHASE_FILL,
+    PHASE_KERNEL,
+    PHASE_READBACK,
+    PHASE_CHECK,
+    PHASE_TOTAL,
+    NPHASES,
+};
+
+/*
+ * ptrs are what the host writes and reads (the SVM allocations, or the
+ * staging arrays for cl_mem), mems the cl_mem buffers.
+ */
+struct model_mem {
+    enum model model;
+    int32_t *ptrs[3];
+    cl_mem mems[3];
+};
+
+static int svm_map(struct cl_program *clprog, void *ptr, cl_map_flags flags)
+{
+    cl_int res;
+
+    res = clEnqueueSVMMap(clprog->queue, CL_TRUE, flags, ptr,
+                          clprog->nwords * sizeof(int32_t), 0, NULL, NULL);
+    return res == CL_SUCCESS ? 0 : -1;
+}
+
+static int svm_unmap(struct cl_program *clprog, void *ptr)
+{
+    cl_event event;
+    cl_int res;
+
+    res = clEnqueueSVMUnmap(clprog->queue, ptr, 0, NULL, &event);
+    if (res != CL_SUCCESS) {
+        return -1;
+    }
+    res = clWaitForEvents(1, &event);
+    clReleaseEvent(event);
+    return res == CL_SUCCESS ? 0 : -1;
+}
+
+static int model_fill(struct cl_program *clprog, struct model_mem *m)
+{
+    size_t size = clprog->nwords * sizeof(int32_t);
+    enum cl_arg arg;
+    cl_int res;
+
+    for (arg = CL_ARG_A; arg <= CL_ARG_B; ++arg) {
+        if (m->model == MODEL_COARSE &&
+            svm_map(clprog, m->ptrs[arg], CL_MAP_WRITE_INVALIDATE_REGION)) {
+            return -1;
+        }
+        fill_linear(m->ptrs[arg], clprog->nwords, cl_arg_pattern[arg].base,
+                    cl_arg_pattern[arg].step);
+        if (m->model == MODEL_COARSE && svm_unmap(clprog, m->ptrs[arg])) {
+            return -1;
+        }
+        if (m->model == MODEL_BUFFER) {
+            res = clEnqueueWriteBuffer(clprog->queue, m->mems[arg], CL_TRUE,
+                                       0, size, m->ptrs[arg], 0, NULL, NULL);
+            if (res != CL_SUCCESS) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static int model_kernel(struct cl_program *clprog, struct model_mem *m)
+{
+    cl_event event;
+    cl_int res;
+
+    if (m->model == MODEL_BUFFER) {
+        /* NULL pointers bind the program's cl_mem, see cl_program_buffer(). */
+        res = cl_program_enqueue(clprog, NULL, NULL, NULL, 0, NULL, &event);
+    } else {
+        res = cl_program_enqueue(clprog, m->ptrs[CL_ARG_A], m->ptrs[CL_ARG_B],
+                                 m->ptrs[CL_ARG_R], 0, NULL, &event);
+    }
+    if (res) {
+        return -1;
+    }
+    res = clWaitForEvents(1, &event);
+    clReleaseEvent(event);
+    return res == CL_SUCCESS ? 0 : -1;
+}
+
+static int model_readback(struct cl_program *clprog, struct model_mem *m)
+{
+    size_t size = clprog->nwords * sizeof(int32_t);
+    cl_int res;
+
+    if (m->model == MODEL_COARSE) {
+        return svm_map(clprog, m->ptrs[CL_ARG_R], CL_MAP_READ);
+    }
+    if (m->model == MODEL_BUFFER) {
+        res = clEnqueueReadBuffer(clprog->queue, m->mems[CL_ARG_R], CL_TRUE,
+                                  0, size, m->ptrs[CL_ARG_R], 0, NULL, NULL);
+        return res == CL_SUCCESS ? 0 : -1;
+    }
+    return 0;
+}
+
+static int model_check(struct cl_program *clprog, struct model_mem *m)
+{
+    int32_t *r = m->ptrs[CL_ARG_R];
+
+    if (cl_program_verify(clprog, r, NULL)) {
+        return -1;
+    }
+    if (m->model == MODEL_COARSE) {
+        return svm_unmap(clprog, r);
+    }
+    /* Scribble, so a run that does not write r fails the next check. */
+    r[0] = -1;
+    return 0;
+}
+
+static int (*const phases[PHASE_TOTAL])(struct cl_program *,
+                                        struct model_mem *) = {
+    [PHASE_FILL] = model_fill,
+    [PHASE_KERNEL] = model_kernel,
+    [PHASE_READBACK] = model_readback,
+    [PHASE_CHECK] = model_check,
+};
+
+static int model_mem_init(struct cl_program *clprog, struct model_mem *m,
+                          enum model model)
+{
+    size_t size = clprog->nwords * sizeof(int32_t);
+    cl_svm_mem_flags flags = CL_MEM_READ_WRITE;
+    enum cl_arg arg;
+
+    memset(m, 0, sizeof(*m));
+    m->model = model;
+    if (model == MODEL_FINE) {
+        flags |= CL_MEM_SVM_FINE_GRAIN_BUFFER;
+    }
+    for (arg = CL_ARG_A; arg <= CL_ARG_R; ++arg) {
+        if (model == MODEL_COARSE || model == MODEL_FINE) {
+            m->ptrs[arg] = clSVMAlloc(clprog->context, flags, size, 0);
+        } else {
+            m->ptrs[arg] = mem_anon_map(size);
+        }
+        if (m->ptrs[arg] == NULL) {
+            return -1;
+        }
+        if (model == MODEL_BUFFER) {
+            m->mems[arg] = cl_program_buffer(clprog, arg);
+            if (m->mems[arg] == NULL) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static void model_mem_fini(struct cl_program *clprog, struct model_mem *m)
+{
+    size_t size = clprog->nwords * sizeof(int32_t);
+    enum cl_arg arg;
+
+    for (arg = CL_ARG_A; arg <= CL_ARG_R; ++arg) {
+        if (m->ptrs[arg] == NULL) {
+            continue;
+        }
+        if (m->model == MODEL_COARSE || m->model == MODEL_FINE) {
+            clSVMFree(clprog->context, m->ptrs[arg]);
+        } else {
+            mem_unmap(m->ptrs[arg], size);
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    size_t nwords = parse_nwords(argc, argv, NWORDS);
+    struct bench_stats stats[NPHASES];
+    cl_device_svm_capabilities caps;
+    enum status status = SUCCESS;
+    uint64_t *samples = NULL, t, start;
+    struct cl_program clprog;
+    unsigned i, iters = ITERS;
+    char *append = "\n";
+    enum model model;
+    struct model_mem m;
+    enum phase p;
+    int res;
+
+    if (argc > 2)
+        iters = strtoul(argv[2], NULL, 0);
+    if (iters < 2) {
+        append = "invalid arguments\n";
+        status = ERROR;
+        goto out;
+    }
+
+    samples = malloc(NPHASES * iters * sizeof(*samples));
+    if (samples == NULL) {
+        append = "allocating samples failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    res = cl_program_init(&clprog, nwords);
+    if (res) {
+        append = "cl program init failed\n";
+        status = ERROR;
+        goto out;
+    }
+    if (clGetDeviceInfo(clprog.device_id, CL_DEVICE_SVM_CAPABILITIES,
+                        sizeof(caps), &caps, NULL)) {
+        caps = 0;
+    }
+
+    printf("%zu bytes per array, %u iterations, medians after the first "
+           "in ms\n", nwords * sizeof(int32_t), iters);
+    printf("%-12s %9s %9s %9s %9s %9s %9s %8s\n", "model", "first", "fill",
+           "kernel", "readback", "check", "total", "GB/s");
+    for (model = 0; model < NMODELS; ++model) {
+        if (model_caps[model] && !(caps & model_caps[model])) {
+            printf("%-12s %9s\n", model_names[model], "unsupported");
+            continue;
+        }
+        if (model_mem_init(&clprog, &m, model)) {
+            model_mem_fini(&clprog, &m);
+            append = "allocating memory failed\n";
+            status = ERROR;
+            goto out;
+        }
+        for (i = 0; i < iters; ++i) {
+            start = time_ns();
+            for (p = 0; p < PHASE_TOTAL; ++p) {
+                t = time_ns();
+                if (phases[p](&clprog, &m)) {
+                    model_mem_fini(&clprog, &m);
+                    append = "model run failed\n";
+                    status = ERROR;
+                    goto out;
+                }
+                samples[p * iters + i] = time_ns() - t;
+            }
+            samples[PHASE_TOTAL * iters + i] = time_ns() - start;
+        }
+        model_mem_fini(&clprog, &m);
+
+        for (p = 0; p < NPHASES; ++p) {
+            bench_stats_compute(samples + p * iters + 1, iters - 1, &stats[p]);
+        }
+        printf("%-12s %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f %8.3f\n",
+               model_names[model], samples[PHASE_TOTAL * iters] / 1e6,
+               stats[PHASE_FILL].median / 1e6,
+               stats[PHASE_KERNEL].median / 1e6,
+               stats[PHASE_READBACK].median / 1e6,
+               stats[PHASE_CHECK].median / 1e6,
+               stats[PHASE_TOTAL].median / 1e6,
+               3.0 * nwords * sizeof(int32_t) / stats[PHASE_TOTAL].median);
+    }
+
+out:
+    free(samples);
+    print_status(status, argv, append);
+    return 0;
+}
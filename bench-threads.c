@@ -0,0 +1,243 @@
+/*
+ * Copyright 2018 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Concurrent submission: N host threads, each with its own queue and kernel
+ * object on the shared context, run the kernel on slices of one anonymous
+ * range. Slices are either disjoint or each twice as long as the disjoint
+ * slice so that neighbouring threads overlap. Every N gets a fresh range,
+ * so the first round of launches ("cold") is dominated by GPU faults and
+ * the following rounds measure steady state submission.
+ *
+ * Usage: bench-threads [nwords, default 16M] [max threads, default 8]
+ *                      [iterations, default 16]
+ */
+#include <pthread.h>
+#include "helpers.h"
+
+#define NWORDS  (1 << 24)
+#define THREADS 8
+#define ITERS   16
+
+struct worker {
+    pthread_t thread;
+    pthread_barrier_t *barrier;
+    cl_command_queue queue;
+    cl_kernel kernel;
+    size_t start;
+    size_t count;
+    unsigned iters;
+    uint64_t *samples;
+    int res;
+};
+
+static int worker_launch(struct worker *worker, uint64_t *ns)
+{
+    size_t local_size = 64, global_size;
+    cl_event event;
+    uint64_t t;
+    cl_int res;
+
+    global_size = ALIGN(worker->count, local_size);
+    t = time_ns();
+    res = clEnqueueNDRangeKernel(worker->queue, worker->kernel, 1,
+                                 &worker->start, &global_size, &local_size,
+                                 0, NULL, &event);
+    if (res != CL_SUCCESS) {
+        return -1;
+    }
+    res = clWaitForEvents(1, &event);
+    *ns = time_ns() - t;
+    clReleaseEvent(event);
+
+    return res == CL_SUCCESS ? 0 : -1;
+}
+
+static void *worker_run(void *arg)
+{
+    struct worker *worker = arg;
+    uint64_t cold;
+    unsigned i;
+
+    pthread_barrier_wait(worker->barrier);
+    worker->res = worker_launch(worker, &cold);
+    pthread_barrier_wait(worker->barrier);
+    for (i = 0; !worker->res && i < worker->iters; ++i) {
+        worker->res = worker_launch(worker, &worker->samples[i]);
+    }
+
+    return NULL;
+}
+
+static int worker_init(struct worker *worker, struct cl_program *clprog,
+                       int *a, int *r, size_t start, size_t count)
+{
+    cl_ulong end = start + count;
+    cl_mem b = cl_program_buffer(clprog, CL_ARG_B);
+    cl_int res;
+
+    if (b == NULL) {
+        return -1;
+    }
+
+    worker->start = start;
+    worker->count = count;
+    worker->queue = clCreateCommandQueueWithProperties(clprog->context,
+                                                       clprog->device_id,
+                                                       NULL, &res);
+    if (res != CL_SUCCESS) {
+        return -1;
+    }
+    worker->kernel = clCreateKernel(clprog->program, "dumb", &res);
+    if (res != CL_SUCCESS) {
+        clReleaseCommandQueue(worker->queue);
+        return -1;
+    }
+
+    /* The bound is the slice end so disjoint slices never spill over. */
+    res = clSetKernelArgSVMPointer(worker->kernel, 0, a);
+    res |= clSetKernelArg(worker->kernel, 1, sizeof(cl_mem), &b);
+    res |= clSetKernelArgSVMPointer(worker->kernel, 2, r);
+    res |= clSetKernelArg(worker->kernel, 3, sizeof(end), &end);
+    if (res != CL_SUCCESS) {
+        clReleaseKernel(worker->kernel);
+        clReleaseCommandQueue(worker->queue);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int run(struct cl_program *clprog, const char *mode, int overlap,
+               unsigned nthreads, unsigned iters)
+{
+    size_t size = clprog->nwords * sizeof(int), slice, bytes = 0;
+    struct worker workers[nthreads];
+    uint64_t t, cold, steady, *samples;
+    pthread_barrier_t barrier;
+    struct bench_stats stats;
+    unsigned i, ninit = 0;
+    int *a, *r, ret = -1;
+
+    a = mem_anon_map(size);
+    r = mem_anon_map(size);
+    samples = malloc(nthreads * iters * sizeof(*samples));
+    if (a == NULL || r == NULL || samples == NULL) {
+        goto out;
+    }
+    cl_program_fill(clprog, a, CL_ARG_A);
+
+    slice = clprog->nwords / nthreads;
+    for (i = 0; i < nthreads; ++i, ++ninit) {
+        size_t start = i * slice, count = overlap ? 2 * slice : slice;
+
+        if (i == nthreads - 1 || start + count > clprog->nwords) {
+            count = clprog->nwords - start;
+        }
+        if (worker_init(&workers[i], clprog, a, r, start, count)) {
+            goto out;
+        }
+        workers[i].barrier = &barrier;
+        workers[i].iters = iters;
+        workers[i].samples = &samples[i * iters];
+        bytes += 3 * count * sizeof(int);
+    }
+
+    pthread_barrier_init(&barrier, NULL, nthreads + 1);
+    for (i = 0; i < nthreads; ++i) {
+        pthread_create(&workers[i].thread, NULL, worker_run, &workers[i]);
+    }
+    pthread_barrier_wait(&barrier);
+    t = time_ns();
+    pthread_barrier_wait(&barrier);
+    cold = time_ns() - t;
+    t = time_ns();
+    for (i = 0; i < nthreads; ++i) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    steady = time_ns() - t;
+    pthread_barrier_destroy(&barrier);
+
+    for (i = 0; i < nthreads; ++i) {
+        if (workers[i].res) {
+            goto out;
+        }
+    }
+    if (verify_zero(r, clprog->nwords, NULL)) {
+        goto out;
+    }
+
+    bench_stats_compute(samples, nthreads * iters, &stats);
+    printf("%-8s %7u %10.3f %10.1f %10.1f %10.3f\n", mode, nthreads,
+           cold / 1e6, stats.median / 1e3, stats.p99 / 1e3,
+           (double)bytes * iters / steady);
+    ret = 0;
+
+out:
+    for (i = 0; i < ninit; ++i) {
+        clReleaseKernel(workers[i].kernel);
+        clReleaseCommandQueue(workers[i].queue);
+    }
+    free(samples);
+    if (r) {
+        mem_unmap(r, size);
+    }
+    if (a) {
+        mem_unmap(a, size);
+    }
+    return ret;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t nwords = parse_nwords(argc, argv, NWORDS);
+    unsigned nthreads, max_threads = THREADS;
+    enum status status = SUCCESS;
+    struct cl_program clprog;
+    unsigned iters = ITERS;
+    char *append = "\n";
+    int res;
+
+    if (argc > 2)
+        max_threads = strtoul(argv[2], NULL, 0);
+    if (argc > 3)
+        iters = strtoul(argv[3], NULL, 0);
+    if (!max_threads || !iters || nwords < max_threads) {
+        append = "invalid arguments\n";
+        status = ERROR;
+        goto out;
+    }
+
+    res = cl_program_init(&clprog, nwords);
+    if (res) {
+        append = "cl program init failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    printf("%-8s %7s %10s %10s %10s %10s\n", "mode", "threads", "cold ms",
+           "p50 us", "p99 us", "GB/s");
+    for (nthreads = 1; nthreads <= max_threads; nthreads *= 2) {
+        if (run(&clprog, "disjoint", 0, nthreads, iters) ||
+            run(&clprog, "overlap", 1, nthreads, iters)) {
+            append = "threaded run failed\n";
+            status = ERROR;
+            goto out;
+        }
+    }
+
+out:
+    print_status(status, argv, append);
+    return 0;
+}
@@ -0,0 +1,298 @@
+/*
+ * Copyright 2018 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * VRAM oversubscription: map 0.5x up to 4x the device global memory size in
+ * system memory, then migrate it to the device a chunk at a time and run the
+ * kernel on each chunk, in sequential (one pass), cyclic and random chunk
+ * order. Reports sustained throughput, per chunk latency percentiles, the
+ * evictions an LRU of device memory size would need for that access order
+ * (modelled here, not observed from the driver) and the pgmigrate_success
+ * delta from /proc/vmstat. The memory is zero so the kernel (r = a + b on the
+ * chunk itself) leaves it unchanged, and it is checked at the end of each
+ * order to catch lost evictions.
+ *
+ * Usage: bench-vram-oversub [device memory, default from the device]
+ *                           [chunk size, default 2M] [passes, default 2]
+ */
+#include "helpers.h"
+
+#define CHUNK       (2UL << 20)
+#define PASSES      2
+
+static const double factors[] = { 0.5, 1.0, 1.5, 2.0, 3.0, 4.0 };
+
+enum order {
+    ORDER_SEQUENTIAL,
+    ORDER_CYCLIC,
+    ORDER_RANDOM,
+    NORDERS,
+};
+
+static const char *order_names[NORDERS] = {
+    [ORDER_SEQUENTIAL] = "sequential",
+    [ORDER_CYCLIC] = "cyclic",
+    [ORDER_RANDOM] = "random",
+};
+
+/*
+ * Chunks resident in a device of capacity chunks, least recently used
+ * evicted first. Index n is the list head, head->next the most recent.
+ */
+struct lru {
+    size_t *prev;
+    size_t *next;
+    unsigned char *resident;
+    size_t n;
+    size_t count;
+    size_t capacity;
+    uint64_t evictions;
+};
+
+static int lru_init(struct lru *lru, size_t n, size_t capacity)
+{
+    lru->prev = malloc((n + 1) * sizeof(size_t));
+    lru->next = malloc((n + 1) * sizeof(size_t));
+    lru->resident = calloc(n, 1);
+    if (!lru->prev || !lru->next || !lru->resident) {
+        free(lru->prev);
+        free(lru->next);
+        free(lru->resident);
+        return -1;
+    }
+    lru->prev[n] = lru->next[n] = n;
+    lru->n = n;
+    lru->count = 0;
+    lru->capacity = capacity ? capacity : 1;
+    lru->evictions = 0;
+    return 0;
+}
+
+static void lru_fini(struct lru *lru)
+{
+    free(lru->prev);
+    free(lru->next);
+    free(lru->resident);
+}
+
+static void lru_unlink(struct lru *lru, size_t i)
+{
+    lru->next[lru->prev[i]] = lru->next[i];
+    lru->prev[lru->next[i]] = lru->prev[i];
+}
+
+static void lru_access(struct lru *lru, size_t i)
+{
+    size_t head = lru->n, victim;
+
+    if (lru->resident[i]) {
+        lru_unlink(lru, i);
+    } else if (lru->count == lru->capacity) {
+        victim = lru->prev[head];
+        lru_unlink(lru, victim);
+        lru->resident[victim] = 0;
+        lru->resident[i] = 1;
+        lru->evictions++;
+    } else {
+        lru->resident[i] = 1;
+        lru->count++;
+    }
+    lru->next[i] = lru->next[head];
+    lru->prev[i] = head;
+    lru->prev[lru->next[head]] = i;
+    lru->next[head] = i;
+}
+
+/* xorshift64, fixed seed so every run uses the same random order. */
+static uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/* Migrate one chunk to the device and run the kernel on it, chained. */
+static int access_chunk(struct cl_program *clprog, void *ptr, size_t chunk,
+                        uint64_t *ns)
+{
+    cl_event events[2];
+    uint64_t t;
+    cl_int res;
+
+    t = time_ns();
+    if (cl_program_migrate_async(clprog, ptr, chunk, 0, 0, NULL, &events[0])) {
+        return -1;
+    }
+    if (cl_program_enqueue(clprog, ptr, ptr, ptr, 1, &events[0], &events[1])) {
+        clWaitForEvents(1, &events[0]);
+        clReleaseEvent(events[0]);
+        return -1;
+    }
+    res = clWaitForEvents(1, &events[1]);
+    *ns = time_ns() - t;
+    clReleaseEvent(events[0]);
+    clReleaseEvent(events[1]);
+
+    return res == CL_SUCCESS ? 0 : -1;
+}
+
+static int run_order(struct cl_program *clprog, char *map, size_t size,
+                     size_t chunk, size_t vram, enum order order,
+                     unsigned passes, uint64_t *samples, double factor)
+{
+    size_t i, c, nchunks = size / chunk, naccess;
+    uint64_t t, ns, state = 0x9e3779b97f4a7c15ULL;
+    uint64_t migrated_before = 0, migrated_after = 0;
+    struct bench_stats stats;
+    cl_event event;
+    struct lru lru;
+    int have_vmstat;
+
+    if (lru_init(&lru, nchunks, vram / chunk)) {
+        return -1;
+    }
+
+    /* Start cold, with everything back in system memory. */
+    if (!cl_program_migrate_async(clprog, map, size,
+                                  CL_MIGRATE_MEM_OBJECT_HOST, 0, NULL,
+                                  &event)) {
+        clWaitForEvents(1, &event);
+        clReleaseEvent(event);
+    }
+
+    naccess = order == ORDER_SEQUENTIAL ? nchunks : passes * nchunks;
+    have_vmstat = !vmstat_read("pgmigrate_success", &migrated_before);
+    t = time_ns();
+    for (i = 0; i < naccess; ++i) {
+        c = order == ORDER_RANDOM ? next_random(&state) % nchunks :
+                                    i % nchunks;
+        if (access_chunk(clprog, map + c * chunk, chunk, &samples[i])) {
+            lru_fini(&lru);
+            return -1;
+        }
+        lru_access(&lru, c);
+    }
+    ns = time_ns() - t;
+    have_vmstat = have_vmstat &&
+                  !vmstat_read("pgmigrate_success", &migrated_after);
+
+    bench_stats_compute(samples, naccess, &stats);
+    printf("%6.1fx %-10s %12zu %9zu %8.3f %10.1f %10.1f %10.1f %19llu",
+           factor, order_names[order], size, naccess,
+           (double)naccess * chunk / ns, stats.median / 1e3,
+           stats.p99 / 1e3, stats.max / 1e3,
+           (unsigned long long)lru.evictions);
+    if (have_vmstat) {
+        printf(" %12llu\n",
+               (unsigned long long)(migrated_after - migrated_before));
+    } else {
+        printf(" %12s\n", "-");
+    }
+    lru_fini(&lru);
+
+    return verify_zero(map, size / sizeof(int), NULL);
+}
+
+int main(int argc, char* argv[])
+{
+    size_t vram = 0, chunk = CHUNK, size, mem_max;
+    enum status status = SUCCESS;
+    struct cl_program clprog;
+    unsigned i, passes = PASSES;
+    uint64_t *samples = NULL;
+    char *append = "\n";
+    cl_ulong global_mem;
+    enum order order;
+    char *map;
+    int res;
+
+    if (argc > 1)
+        vram = parse_size(argv[1]);
+    if (argc > 2)
+        chunk = ALIGN(parse_size(argv[2]), 1UL << 12);
+    if (argc > 3)
+        passes = strtoul(argv[3], NULL, 0);
+    if (!chunk || !passes) {
+        append = "invalid arguments\n";
+        status = ERROR;
+        goto out;
+    }
+
+    res = cl_program_init(&clprog, chunk / sizeof(int));
+    if (res) {
+        append = "cl program init failed\n";
+        status = ERROR;
+        goto out;
+    }
+    if (!vram) {
+        if (clGetDeviceInfo(clprog.device_id, CL_DEVICE_GLOBAL_MEM_SIZE,
+                            sizeof(global_mem), &global_mem, NULL)) {
+            append = "querying device memory size failed\n";
+            status = ERROR;
+            goto out;
+        }
+        vram = global_mem;
+    }
+    vram = ALIGN(vram, chunk);
+
+    /* Keep a quarter of system memory for everything else. */
+    mem_max = (size_t)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE) / 4 * 3;
+    samples = malloc(passes * ALIGN((size_t)(vram * 4.0), chunk) / chunk *
+                     sizeof(*samples));
+    if (samples == NULL) {
+        append = "allocating samples failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    printf("device memory %zu bytes, chunk %zu bytes, latencies in us\n",
+           vram, chunk);
+    printf("%7s %-10s %12s %9s %8s %10s %10s %10s %19s %12s\n", "factor",
+           "order", "bytes", "accesses", "GB/s", "p50", "p99", "max",
+           "lru-model-evictions", "pgmigrate");
+    for (i = 0; i < sizeof(factors) / sizeof(factors[0]); ++i) {
+        size = ALIGN((size_t)(vram * factors[i]), chunk);
+        if (size > mem_max) {
+            printf("%6.1fx skipped, %zu bytes is more than 3/4 of system "
+                   "memory\n", factors[i], size);
+            continue;
+        }
+
+        map = mem_anon_map(size);
+        if (map == NULL) {
+            append = "mapping anon failed\n";
+            status = ERROR;
+            goto out;
+        }
+        /* Populate, migrations should move pages and not allocate them. */
+        memset(map, 0, size);
+
+        for (order = 0; order < NORDERS; ++order) {
+            if (run_order(&clprog, map, size, chunk, vram, order, passes,
+                          samples, factors[i])) {
+                append = "oversubscribed run failed\n";
+                status = ERROR;
+                mem_unmap(map, size);
+                goto out;
+            }
+        }
+        mem_unmap(map, size);
+    }
+
+out:
+    free(samples);
+    print_status(status, argv, append);
+    return 0;
+}
@@ -22,6 +22,8 @@
 #include <sys/types.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 #include <hugetlbfs.h>
 #include <stdarg.h>
 #include <stdlib.h>
@@ -29,81 +31,546 @@
 #include <errno.h>
 #include <string.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <math.h>
+#include <time.h>
+
+#include "numa.h"
+#include "pagemap.h"
+#include "verify.h"
 
 #define ALIGN(v, a) (((v) + ((a) - 1)) & ~((a) - 1))
 
+static inline uint64_t time_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Parse a byte count with an optional K, M or G suffix (powers of 2). */
+static size_t parse_size(const char *str)
+{
+    char *end;
+    size_t size = strtoull(str, &end, 0);
+
+    switch (*end) {
+    case 'G': case 'g':
+        size <<= 10;
+        /* Fall-through */
+    case 'M': case 'm':
+        size <<= 10;
+        /* Fall-through */
+    case 'K': case 'k':
+        size <<= 10;
+        break;
+    }
+    return size;
+}
+
+/*
+ * Number of words a test works on: argv[1] if given, else $SVM_CL_NWORDS,
+ * else def. Both take a K, M or G suffix, "4G" is 4Gi words (16GiB).
+ */
+static size_t parse_nwords(int argc, char *argv[], size_t def)
+{
+    const char *env = getenv("SVM_CL_NWORDS");
+    size_t nwords = 0;
+
+    if (argc > 1) {
+        nwords = parse_size(argv[1]);
+    } else if (env && *env) {
+        nwords = parse_size(env);
+    }
+    return nwords ? nwords : def;
+}
+
+/*
+ * Read the nkeys counters keys from /proc/vmstat into vals, in one pass.
+ * Counters the kernel does not have are left alone. Returns how many were
+ * found, -1 if /proc/vmstat cannot be read.
+ */
+static int vmstat_read_keys(const char *const *keys, unsigned nkeys,
+                            uint64_t *vals)
+{
+    char name[64];
+    unsigned long long v;
+    int found = 0;
+    unsigned i;
+    FILE *file;
+
+    file = fopen("/proc/vmstat", "r");
+    if (file == NULL) {
+        return -1;
+    }
+    while (fscanf(file, "%63s %llu", name, &v) == 2) {
+        for (i = 0; i < nkeys; ++i) {
+            if (!strcmp(name, keys[i])) {
+                vals[i] = v;
+                found++;
+                break;
+            }
+        }
+    }
+    fclose(file);
+    return found;
+}
+
+/* Read counter key from /proc/vmstat. Returns -1 if it is not there. */
+static int vmstat_read(const char *key, uint64_t *val)
+{
+    return vmstat_read_keys(&key, 1, val) == 1 ? 0 : -1;
+}
+
+
+#ifdef SVM_CL_SUITE
+/*
+ * When the tests are linked into the suite runner (suite.c) they all run in
+ * one process and share one OpenCL context. The helpers then record what a
+ * scenario maps and sets up, so the runner can release whatever was left
+ * behind before starting the next scenario. The map table starts with
+ * CL_SUITE_MAPS slots and doubles when full.
+ */
+#define CL_SUITE_MAPS 16
+
+struct cl_program;
+
+struct cl_suite_map {
+    void *ptr;
+    size_t size;
+    int huge;
+};
+
+struct cl_suite {
+    struct cl_suite_map *maps;
+    unsigned nmaps;
+    struct cl_program *base;
+    struct cl_program *current;
+    int status;
+};
+
+extern struct cl_suite cl_suite;
+
+static void suite_map_add(void *ptr, size_t size, int huge)
+{
+    struct cl_suite_map *maps;
+    unsigned i, n;
+
+    for (i = 0; i < cl_suite.nmaps; ++i) {
+        if (cl_suite.maps[i].ptr == NULL) {
+            break;
+        }
+    }
+    if (i == cl_suite.nmaps) {
+        n = cl_suite.nmaps ? 2 * cl_suite.nmaps : CL_SUITE_MAPS;
+        maps = realloc(cl_suite.maps, n * sizeof(*maps));
+        if (maps == NULL) {
+            fprintf(stderr, "suite: cannot track mapping %p, it will leak "
+                    "into the next scenario\n", ptr);
+            return;
+        }
+        memset(maps + cl_suite.nmaps, 0,
+               (n - cl_suite.nmaps) * sizeof(*maps));
+        cl_suite.maps = maps;
+        cl_suite.nmaps = n;
+    }
+    cl_suite.maps[i].ptr = ptr;
+    cl_suite.maps[i].size = size;
+    cl_suite.maps[i].huge = huge;
+}
+
+static void suite_map_del(void *ptr)
+{
+    unsigned i;
+
+    for (i = 0; i < cl_suite.nmaps; ++i) {
+        if (cl_suite.maps[i].ptr == ptr) {
+            cl_suite.maps[i].ptr = NULL;
+            return;
+        }
+    }
+}
+#else
+static inline void suite_map_add(void *ptr, size_t size, int huge) {}
+static inline void suite_map_del(void *ptr) {}
+#endif
+
+
+/*
+ * How the mem_*_map() allocators populate what they map, so host first
+ * touch faults can be taken out of test setup. Set with SVM_CL_POPULATE or
+ * mem_populate_set():
+ *   none            nothing, pages fault in on first touch (default)
+ *   map-populate    MAP_POPULATE
+ *   willneed        MADV_WILLNEED, only starts readahead for file maps
+ *   populate-read   MADV_POPULATE_READ (Linux 5.14)
+ *   populate-write  MADV_POPULATE_WRITE (Linux 5.14)
+ *   locked          MAP_LOCKED, populated and kept resident
+ * A mode the kernel or RLIMIT_MEMLOCK does not allow fails the mapping.
+ * Pages are populated as mapped, so a range that wants MADV_HUGEPAGE or
+ * MADV_NOHUGEPAGE must be mapped with mem_anon_map_advise(), madvise()
+ * after mem_anon_map() comes too late.
+ */
+#ifndef MADV_POPULATE_READ
+#define MADV_POPULATE_READ  22
+#endif
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+
+enum mem_populate {
+    MEM_POPULATE_NONE,
+    MEM_POPULATE_MAP,
+    MEM_POPULATE_WILLNEED,
+    MEM_POPULATE_READ,
+    MEM_POPULATE_WRITE,
+    MEM_POPULATE_LOCKED,
+    MEM_NPOPULATE,
+};
+
+static const char *mem_populate_names[MEM_NPOPULATE] = {
+    [MEM_POPULATE_NONE] = "none",
+    [MEM_POPULATE_MAP] = "map-populate",
+    [MEM_POPULATE_WILLNEED] = "willneed",
+    [MEM_POPULATE_READ] = "populate-read",
+    [MEM_POPULATE_WRITE] = "populate-write",
+    [MEM_POPULATE_LOCKED] = "locked",
+};
+
+static int mem_populate_mode = -1;
+
+static enum mem_populate mem_populate_get(void)
+{
+    const char *env;
+    unsigned i;
+
+    if (mem_populate_mode >= 0) {
+        return mem_populate_mode;
+    }
+    mem_populate_mode = MEM_POPULATE_NONE;
+    env = getenv("SVM_CL_POPULATE");
+    if (env == NULL || *env == '\0') {
+        return mem_populate_mode;
+    }
+    for (i = 0; i < MEM_NPOPULATE; ++i) {
+        if (!strcmp(env, mem_populate_names[i])) {
+            mem_populate_mode = i;
+            return mem_populate_mode;
+        }
+    }
+    fprintf(stderr, "SVM_CL_POPULATE: unknown mode %s\n", env);
+    return mem_populate_mode;
+}
+
+static void mem_populate_set(enum mem_populate mode)
+{
+    mem_populate_mode = mode;
+}
+
+/*
+ * NUMA placement of what mem_anon_map(), mem_share_map() and hugefs_alloc()
+ * return, from SVM_CL_NUMA (see numa.h for the syntax) or mem_numa_set().
+ * File maps keep the page cache placement.
+ */
+static struct numa_placement mem_numa = { NUMA_NPOLICIES, 0 };
+
+static const struct numa_placement *mem_numa_get(void)
+{
+    const char *env;
+
+    if (mem_numa.policy != NUMA_NPOLICIES) {
+        return &mem_numa;
+    }
+    mem_numa.policy = NUMA_DEFAULT;
+    env = getenv("SVM_CL_NUMA");
+    if (env && *env && numa_parse(env, &mem_numa)) {
+        fprintf(stderr, "SVM_CL_NUMA: invalid placement %s\n", env);
+        mem_numa.policy = NUMA_DEFAULT;
+        mem_numa.nodes = 0;
+    }
+    return &mem_numa;
+}
+
+static void mem_numa_set(const struct numa_placement *placement)
+{
+    mem_numa = *placement;
+}
+
+/* Bind a new mapping, pages populated by mmap() itself are moved. */
+static int mem_numa_apply(void *ptr, size_t size)
+{
+    const struct numa_placement *placement = mem_numa_get();
 
-void *mem_anon_map(size_t size)
+    if (placement->policy == NUMA_DEFAULT) {
+        return 0;
+    }
+    return numa_mbind(ptr, size, placement, MPOL_MF_MOVE);
+}
+
+/*
+ * Map and apply the SVM_CL_POPULATE mode. An advice >= 0 is given to
+ * madvise() before anything is populated, so pages the populate mode
+ * faults in follow it (MADV_HUGEPAGE must come first or THP ranges end up
+ * on 4K pages); map-populate and locked then become MADV_POPULATE_WRITE
+ * and mlock().
+ */
+static void *mem_map_advise(size_t size, int flags, int fd, int advice)
 {
+    enum mem_populate mode = mem_populate_get();
+    int populate = -1;
     void *res;
 
     /* Align on 4K pages ... no real need for that though ... */
     size = ALIGN(size, 1 << 12);
 
-    res = mmap(0, size, PROT_READ | PROT_WRITE,
-               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (advice < 0 && mode == MEM_POPULATE_MAP) {
+        flags |= MAP_POPULATE;
+    } else if (advice < 0 && mode == MEM_POPULATE_LOCKED) {
+        flags |= MAP_LOCKED;
+    }
+    res = mmap(0, size, PROT_READ | PROT_WRITE, flags, fd, 0);
     if (res == MAP_FAILED) {
         return NULL;
     }
+    if (fd < 0 && mem_numa_apply(res, size)) {
+        goto fail;
+    }
+    if (advice >= 0 && madvise(res, size, advice)) {
+        goto fail;
+    }
+
+    if (mode == MEM_POPULATE_WILLNEED) {
+        populate = MADV_WILLNEED;
+    } else if (mode == MEM_POPULATE_READ) {
+        populate = MADV_POPULATE_READ;
+    } else if (mode == MEM_POPULATE_WRITE ||
+               (advice >= 0 && mode == MEM_POPULATE_MAP)) {
+        populate = MADV_POPULATE_WRITE;
+    }
+    if (populate >= 0 && madvise(res, size, populate)) {
+        goto fail;
+    }
+    if (advice >= 0 && mode == MEM_POPULATE_LOCKED && mlock(res, size)) {
+        goto fail;
+    }
+    suite_map_add(res, size, 0);
     return res;
+
+fail:
+    munmap(res, size);
+    return NULL;
 }
 
-void *mem_share_map(size_t size)
+static void *mem_map(size_t size, int flags, int fd)
 {
-    void *res;
+    return mem_map_advise(size, flags, fd, -1);
+}
 
-    /* Align on 4K pages ... no real need for that though ... */
+static void *mem_anon_map(size_t size)
+{
+    return mem_map(size, MAP_PRIVATE | MAP_ANONYMOUS, -1);
+}
+
+/* mem_anon_map() with advice (MADV_HUGEPAGE...) given before populating. */
+static void *mem_anon_map_advise(size_t size, int advice)
+{
+    return mem_map_advise(size, MAP_PRIVATE | MAP_ANONYMOUS, -1, advice);
+}
+
+static void *mem_share_map(size_t size)
+{
+    return mem_map(size, MAP_SHARED | MAP_ANONYMOUS, -1);
+}
+
+static void *mem_file_map_private(int fd, size_t size)
+{
+    return mem_map(size, MAP_PRIVATE | MAP_FILE, fd);
+}
+
+static void *mem_file_map_share(int fd, size_t size)
+{
+    return mem_map(size, MAP_SHARED | MAP_FILE, fd);
+}
+
+static void mem_unmap(void *ptr, size_t size)
+{
     size = ALIGN(size, 1 << 12);
+    suite_map_del(ptr);
+    munmap(ptr, size);
+}
 
-    res = mmap(0, size, PROT_READ | PROT_WRITE,
-               MAP_SHARED | MAP_ANONYMOUS, -1, 0);
-    if (res == MAP_FAILED) {
+/*
+ * Shmem backings for sharing between processes: a memfd, a memfd of
+ * hugetlb pages (needs pages in the default size pool, nr_hugepages) and a
+ * file on a tmpfs mounted with huge=always or huge=within_size, taken from
+ * SVM_CL_TMPFS_HUGE or else the first such mount in /proc/mounts. The fd
+ * is closed, the mapping keeps the memory. Unmap the hugetlb one with
+ * mem_memfd_hugetlb_unmap(), the others with mem_unmap().
+ */
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC         0x0001U
+#endif
+#ifndef MFD_HUGETLB
+#define MFD_HUGETLB         0x0004U
+#endif
+
+static void *mem_fd_map(int fd, size_t size)
+{
+    void *res = NULL;
+
+    if (fd < 0) {
         return NULL;
     }
+    if (!ftruncate(fd, size)) {
+        res = mem_map(size, MAP_SHARED, fd);
+    }
+    close(fd);
     return res;
 }
 
-void *mem_file_map_private(int fd, size_t size)
+static void *mem_memfd_map(size_t size)
 {
-    void *res;
-
-    /* Align on 4K pages ... no real need for that though ... */
     size = ALIGN(size, 1 << 12);
+    return mem_fd_map(syscall(SYS_memfd_create, "svm-cl", MFD_CLOEXEC),
+                      size);
+}
 
-    res = mmap(0, size, PROT_READ | PROT_WRITE,
-               MAP_PRIVATE | MAP_FILE, fd, 0);
-    if (res == MAP_FAILED) {
+static size_t mem_hugetlb_size(void)
+{
+    long size = gethugepagesize();
+
+    return size > 0 ? size : 0;
+}
+
+static void *mem_memfd_hugetlb_map(size_t size)
+{
+    size_t huge = mem_hugetlb_size();
+
+    if (!huge) {
         return NULL;
     }
-    return res;
+    size = ALIGN(size, huge);
+    return mem_fd_map(syscall(SYS_memfd_create, "svm-cl",
+                              MFD_CLOEXEC | MFD_HUGETLB), size);
 }
 
-void *mem_file_map_share(int fd, size_t size)
+static void mem_memfd_hugetlb_unmap(void *ptr, size_t size)
 {
-    void *res;
+    mem_unmap(ptr, ALIGN(size, mem_hugetlb_size()));
+}
 
-    /* Align on 4K pages ... no real need for that though ... */
-    size = ALIGN(size, 1 << 12);
+static const char *mem_tmpfs_huge_dir(void)
+{
+    static char dir[PATH_MAX];
+    char line[1024], path[PATH_MAX], type[64], opts[512];
+    const char *env = getenv("SVM_CL_TMPFS_HUGE");
+    FILE *file;
 
-    res = mmap(0, size, PROT_READ | PROT_WRITE,
-               MAP_SHARED | MAP_FILE, fd, 0);
-    if (res == MAP_FAILED) {
+    if (env && *env) {
+        return env;
+    }
+    if (*dir) {
+        return dir;
+    }
+    file = fopen("/proc/mounts", "r");
+    if (file == NULL) {
         return NULL;
     }
-    return res;
+    while (fgets(line, sizeof(line), file)) {
+        if (sscanf(line, "%*s %4095s %63s %511s", path, type, opts) != 3 ||
+            strcmp(type, "tmpfs")) {
+            continue;
+        }
+        if (strstr(opts, "huge=always") || strstr(opts, "huge=within_size")) {
+            snprintf(dir, sizeof(dir), "%s", path);
+            break;
+        }
+    }
+    fclose(file);
+    return *dir ? dir : NULL;
 }
 
-void mem_unmap(void *ptr, size_t size)
+static void *mem_tmpfs_huge_map(size_t size)
 {
-    size = ALIGN(size, 1 << 12);
-    munmap(ptr, size);
+    const char *dir = mem_tmpfs_huge_dir();
+    char path[PATH_MAX];
+    int fd;
+
+    if (dir == NULL) {
+        return NULL;
+    }
+    snprintf(path, sizeof(path), "%s/svm-cl-XXXXXX", dir);
+    fd = mkstemp(path);
+    if (fd < 0) {
+        return NULL;
+    }
+    unlink(path);
+    return mem_fd_map(fd, ALIGN(size, 1 << 12));
+}
+
+/*
+ * Write n words of the pattern word i = base + i * step at the current file
+ * offset, or read n words from it and check them. Done a chunk at a time,
+ * not a syscall per word, so large files stay quick to set up and check.
+ */
+#define FILE_CHUNK_WORDS (1UL << 18)
+
+static int file_write_linear(int fd, size_t n, int32_t base, int32_t step)
+{
+    size_t i, count, len;
+    int32_t *buf;
+    int ret = -1;
+
+    buf = malloc(FILE_CHUNK_WORDS * sizeof(int32_t));
+    if (buf == NULL) {
+        return -1;
+    }
+    for (i = 0; i < n; i += count) {
+        count = n - i < FILE_CHUNK_WORDS ? n - i : FILE_CHUNK_WORDS;
+        len = count * sizeof(int32_t);
+        fill_linear(buf, count, (uint32_t)base + (uint32_t)i * step, step);
+        if (write(fd, buf, len) != (ssize_t)len) {
+            goto out;
+        }
+    }
+    ret = 0;
+out:
+    free(buf);
+    return ret;
+}
+
+static int file_verify_linear(int fd, size_t n, int32_t base, int32_t step)
+{
+    size_t i, count, len;
+    int32_t *buf;
+    int ret = -1;
+
+    buf = malloc(FILE_CHUNK_WORDS * sizeof(int32_t));
+    if (buf == NULL) {
+        return -1;
+    }
+    for (i = 0; i < n; i += count) {
+        count = n - i < FILE_CHUNK_WORDS ? n - i : FILE_CHUNK_WORDS;
+        len = count * sizeof(int32_t);
+        if (read(fd, buf, len) != (ssize_t)len ||
+            verify_linear(buf, count, (uint32_t)base + (uint32_t)i * step,
+                          step, NULL)) {
+            goto out;
+        }
+    }
+    ret = 0;
+out:
+    free(buf);
+    return ret;
 }
 
 
-void *hugefs_alloc(size_t size)
+static void *hugefs_alloc(size_t size)
 {
+    static int printed;
     long pagesizes[4];
     int n, i, idx;
     void *res;
@@ -118,16 +585,28 @@ void *hugefs_alloc(size_t size)
         }
     }
 
-    printf("Use hugepagesize %ld 0x%08lx\n", pagesizes[idx], pagesizes[idx]);
+    if (!printed++) {
+        printf("Use hugepagesize %ld 0x%08lx\n", pagesizes[idx],
+               pagesizes[idx]);
+    }
 
     size = ALIGN(size, pagesizes[idx]);
 
     res = get_hugepage_region(size, GHR_STRICT);
+    if (res == NULL) {
+        return NULL;
+    }
+    if (mem_numa_apply(res, size)) {
+        free_hugepage_region(res);
+        return NULL;
+    }
+    suite_map_add(res, size, 1);
     return res;
 }
 
-void hugefs_free(void *ptr)
+static void hugefs_free(void *ptr)
 {
+    suite_map_del(ptr);
     free_hugepage_region(ptr);
 }
 
@@ -138,6 +617,10 @@ enum status {
     ERROR,
 };
 
+#ifdef SVM_CL_SUITE
+static void cl_suite_end(enum status status);
+#endif
+
 static inline void print_status(enum status status, char *argv[],
                                 const char *msg, ...)
 {
@@ -162,9 +645,139 @@ static inline void print_status(enum status status, char *argv[],
     va_end(ap);
 
     fflush(stdout);
+
+#ifdef SVM_CL_SUITE
+    /* Every test ends with print_status() while its cl_program is live. */
+    cl_suite_end(status);
+#endif
 }
 
 
+/*
+ * Profiling: with SVM_CL_PROFILE=1 the queue is created with profiling
+ * enabled and every command the helpers enqueue (write, kernel, read,
+ * migrate) is recorded with its QUEUED/SUBMIT/START/END timestamps. This
+ * separates driver submission overhead from execution on the device, where
+ * GPU fault handling is accounted. Each entry carries the count of
+ * cl_program_run_nocheck() calls made so far, so 0 is setup before the
+ * first run. The record is dumped at exit.
+ */
+struct cl_prof_entry {
+    const char *what;
+    unsigned run;
+    cl_ulong queued;
+    cl_ulong submit;
+    cl_ulong start;
+    cl_ulong end;
+};
+
+struct cl_prof {
+    unsigned run;
+    unsigned nentries;
+    unsigned size;
+    struct cl_prof_entry *entries;
+};
+
+/*
+ * What the kernel did, per phase. With SVM_CL_VMSTAT=1 each phase of a test
+ * is bracketed by snapshots of the /proc/self/stat fault counts, getrusage()
+ * and the /proc/vmstat counters below. The deltas and time are summed per
+ * phase and printed when the test exits, so a slowdown can be put down to
+ * extra faults, failed migrations or THP splits. /proc/vmstat is system
+ * wide: run one test at a time (run-all.sh -j 1) when those matter.
+ */
+enum cl_vm_phase {
+    CL_VM_INIT,
+    CL_VM_POPULATE,
+    CL_VM_MIGRATE,
+    CL_VM_KERNEL,
+    CL_VM_READBACK,
+    CL_VM_VERIFY,
+    CL_VM_NPHASES,
+};
+
+static const char *cl_vm_phases[CL_VM_NPHASES] = {
+    [CL_VM_INIT] = "init",
+    [CL_VM_POPULATE] = "populate",
+    [CL_VM_MIGRATE] = "migrate",
+    [CL_VM_KERNEL] = "kernel",
+    [CL_VM_READBACK] = "readback",
+    [CL_VM_VERIFY] = "verify",
+};
+
+static const char *const cl_vm_keys[] = {
+    "pgmigrate_success",
+    "pgmigrate_fail",
+    "thp_fault_alloc",
+    "thp_fault_fallback",
+    "thp_split_page",
+    "thp_migration_success",
+    "thp_migration_fail",
+    "thp_migration_split",
+    "numa_hit",
+    "numa_miss",
+    "numa_local",
+    "numa_hint_faults",
+    "numa_pages_migrated",
+};
+
+#define CL_VM_NKEYS (sizeof(cl_vm_keys) / sizeof(cl_vm_keys[0]))
+
+/* Fields of a sample, the vmstat counters follow in cl_vm_keys order. */
+enum {
+    CL_VM_NS,
+    CL_VM_MINFLT,
+    CL_VM_MAJFLT,
+    CL_VM_UTIME,
+    CL_VM_STIME,
+    CL_VM_NVCSW,
+    CL_VM_NIVCSW,
+    CL_VM_VMSTAT,
+    CL_VM_NFIELDS = CL_VM_VMSTAT + CL_VM_NKEYS,
+};
+
+struct cl_vm_sample {
+    uint64_t v[CL_VM_NFIELDS];
+};
+
+struct cl_vm {
+    unsigned count[CL_VM_NPHASES];
+    struct cl_vm_sample total[CL_VM_NPHASES];
+};
+
+/*
+ * Access patterns over the same r = a + b, all in the program source below.
+ * Except page-stride each visits every word once, only the order differs,
+ * so results check the same. page-stride computes one word every param
+ * bytes and leaves the rest of r alone. param is the default for each,
+ * see cl_kernel_parse().
+ */
+enum cl_kernel_id {
+    CL_KERNEL_DUMB,
+    CL_KERNEL_STRIDE,
+    CL_KERNEL_PAGE_STRIDE,
+    CL_KERNEL_GATHER,
+    CL_KERNEL_TILED,
+    CL_NKERNELS,
+};
+
+static const struct {
+    const char *name;
+    const char *entry;
+    cl_ulong param;
+} cl_kernels[CL_NKERNELS] = {
+    /* In order. */
+    [CL_KERNEL_DUMB] = { "dumb", "dumb", 0 },
+    /* Neighbour work items param words apart. */
+    [CL_KERNEL_STRIDE] = { "stride", "stride", 16 },
+    /* One word every param bytes: 4K, 64K or 2M for a touch per page. */
+    [CL_KERNEL_PAGE_STRIDE] = { "page-stride", "page_stride", 1 << 12 },
+    /* Random order, param is the seed. */
+    [CL_KERNEL_GATHER] = { "gather", "gather", 1 },
+    /* 16x16 tiles of rows param words wide. */
+    [CL_KERNEL_TILED] = { "tiled", "tiled", 1 << 10 },
+};
+
 struct cl_program {
     cl_command_queue queue;
     cl_device_id device_id;
@@ -172,254 +785,1556 @@ struct cl_program {
     cl_program program;
     cl_context context;
     cl_kernel kernel;
+    enum cl_kernel_id kernel_id;
+    cl_ulong kernel_param;
     cl_mem mem_a;
     cl_mem mem_b;
     cl_mem mem_r;
-    unsigned nwords;
-    int *a;
-    int *b;
+    size_t nwords;
     int *r;
+    int *out;
+    uint64_t kernel_ns;
+    uint64_t readback_ns;
+    struct cl_prof *prof;
+    struct cl_vm *vm;
+    int pagemap;
 };
 
-static const char *kernel =                                     "\n" \
-"__kernel void dumb(__global int *a,                             \n" \
-"                   __global int *b,                             \n" \
-"                   __global int *r,                             \n" \
-"                   const unsigned int n)                        \n" \
-"{                                                               \n" \
-"    int id = get_global_id(0);                                  \n" \
-"    // Bounds check                                             \n" \
-"    if (id < n)                                                 \n" \
-"        r[id] = a[id] + b[id];                                  \n" \
-"}                                                               \n";
+static int cl_prof_enabled(void)
+{
+    const char *env = getenv("SVM_CL_PROFILE");
+
+    return env && strcmp(env, "0");
+}
 
-static int cl_program_init(struct cl_program *clprog, unsigned nwords)
+/* Record a completed command and drop the reference on its event. */
+static void cl_prof_record(struct cl_program *clprog, const char *what,
+                           cl_event event)
 {
-    size_t size = nwords * sizeof(int32_t);
-    cl_event event;
-    unsigned i;
-    cl_int res;
+    struct cl_prof *prof = clprog->prof;
+    struct cl_prof_entry *entry;
 
-    clprog->nwords = nwords;
-    clprog->a = malloc(size);
-    clprog->b = malloc(size);
-    clprog->r = malloc(size);
-    for (i = 0; i < nwords; ++i) {
-        clprog->a[i] = i;
-        clprog->b[i] = -i;
-        clprog->r[i] = 0xcafedead;
+    if (prof == NULL) {
+        clReleaseEvent(event);
+        return;
     }
+    if (prof->nentries == prof->size) {
+        unsigned size = prof->size ? 2 * prof->size : 64;
 
-    res = clGetPlatformIDs(1, &clprog->platform, NULL);
-    if (res != CL_SUCCESS) {
-        return -1;
+        entry = realloc(prof->entries, size * sizeof(*entry));
+        if (entry == NULL) {
+            clReleaseEvent(event);
+            return;
+        }
+        prof->entries = entry;
+        prof->size = size;
     }
 
-    res = clGetDeviceIDs(clprog->platform, CL_DEVICE_TYPE_GPU,
-                         1, &clprog->device_id, NULL);
-    if (res != CL_SUCCESS) {
-        return -1;
-    }
+    entry = &prof->entries[prof->nentries++];
+    memset(entry, 0, sizeof(*entry));
+    entry->what = what;
+    entry->run = prof->run;
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_QUEUED,
+                            sizeof(cl_ulong), &entry->queued, NULL);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_SUBMIT,
+                            sizeof(cl_ulong), &entry->submit, NULL);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START,
+                            sizeof(cl_ulong), &entry->start, NULL);
+    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END,
+                            sizeof(cl_ulong), &entry->end, NULL);
+    clReleaseEvent(event);
+}
 
-    clprog->context = clCreateContext(0, 1, &clprog->device_id,
-                                     NULL, NULL, &res);
-    if (res != CL_SUCCESS) {
-        return -1;
+/* Most recent entry for the given command ("kernel", "migrate", ...). */
+static const struct cl_prof_entry *cl_prof_last(struct cl_program *clprog,
+                                                const char *what)
+{
+    struct cl_prof *prof = clprog->prof;
+    unsigned i;
+
+    if (prof == NULL) {
+        return NULL;
     }
-    clprog->queue = clCreateCommandQueueWithProperties(clprog->context,
-                                                       clprog->device_id,
-                                                       NULL, &res);
-    if (res != CL_SUCCESS) {
-        goto error_queue;
+    for (i = prof->nentries; i--;) {
+        if (!strcmp(prof->entries[i].what, what)) {
+            return &prof->entries[i];
+        }
+    }
+    return NULL;
+}
+
+static void cl_prof_dump(struct cl_prof *prof, FILE *file)
+{
+    struct cl_prof_entry *entry;
+    unsigned i;
+
+    fprintf(file, "%4s %-16s %12s %12s %12s (us)\n", "run", "command",
+            "queue->sub", "sub->start", "start->end");
+    for (i = 0; i < prof->nentries; ++i) {
+        entry = &prof->entries[i];
+        fprintf(file, "%4u %-16s %12.1f %12.1f %12.1f\n",
+                entry->run, entry->what,
+                (entry->submit - entry->queued) / 1e3,
+                (entry->start - entry->submit) / 1e3,
+                (entry->end - entry->start) / 1e3);
+    }
+}
+
+static void cl_prof_free(struct cl_prof *prof)
+{
+    if (prof) {
+        free(prof->entries);
+        free(prof);
+    }
+}
+
+static struct cl_prof *cl_prof_atexit_prof;
+
+static void cl_prof_atexit(void)
+{
+    if (cl_prof_atexit_prof) {
+        cl_prof_dump(cl_prof_atexit_prof, stdout);
+    }
+}
+
+static int cl_vm_enabled(void)
+{
+    const char *env = getenv("SVM_CL_VMSTAT");
+
+    return env && strcmp(env, "0");
+}
+
+static void cl_vm_take(struct cl_vm_sample *sample)
+{
+    unsigned long long minflt = 0, majflt = 0;
+    struct rusage usage;
+    char buf[1024], *p;
+    FILE *file;
+
+    memset(sample, 0, sizeof(*sample));
+    sample->v[CL_VM_NS] = time_ns();
+
+    /* The fields after the command name, which may hold spaces. */
+    file = fopen("/proc/self/stat", "r");
+    if (file) {
+        if (fgets(buf, sizeof(buf), file) && (p = strrchr(buf, ')'))) {
+            sscanf(p + 1, " %*c %*d %*d %*d %*d %*d %*u %llu %*u %llu",
+                   &minflt, &majflt);
+        }
+        fclose(file);
+    }
+    sample->v[CL_VM_MINFLT] = minflt;
+    sample->v[CL_VM_MAJFLT] = majflt;
+
+    if (!getrusage(RUSAGE_SELF, &usage)) {
+        sample->v[CL_VM_UTIME] = usage.ru_utime.tv_sec * 1000000ULL +
+                                 usage.ru_utime.tv_usec;
+        sample->v[CL_VM_STIME] = usage.ru_stime.tv_sec * 1000000ULL +
+                                 usage.ru_stime.tv_usec;
+        sample->v[CL_VM_NVCSW] = usage.ru_nvcsw;
+        sample->v[CL_VM_NIVCSW] = usage.ru_nivcsw;
+    }
+
+    vmstat_read_keys(cl_vm_keys, CL_VM_NKEYS, &sample->v[CL_VM_VMSTAT]);
+}
+
+/* Start a phase, a no-op unless SVM_CL_VMSTAT is set. */
+static void cl_vm_begin(struct cl_program *clprog,
+                        struct cl_vm_sample *start)
+{
+    if (clprog->vm) {
+        cl_vm_take(start);
+    }
+}
+
+/* End a phase begun with cl_vm_begin() and add it up. */
+static void cl_vm_end(struct cl_program *clprog, enum cl_vm_phase phase,
+                      const struct cl_vm_sample *start)
+{
+    struct cl_vm *vm = clprog->vm;
+    struct cl_vm_sample end;
+    unsigned i;
+
+    if (vm == NULL) {
+        return;
+    }
+    cl_vm_take(&end);
+    vm->count[phase]++;
+    for (i = 0; i < CL_VM_NFIELDS; ++i) {
+        vm->total[phase].v[i] += end.v[i] - start->v[i];
+    }
+}
+
+/* One line per phase, vmstat counters only when they moved. */
+static void cl_vm_dump(const struct cl_vm *vm, FILE *file)
+{
+    const struct cl_vm_sample *total;
+    unsigned phase, i;
+
+    fprintf(file, "%-9s %6s %10s %9s %7s %9s %9s %7s %7s  vmstat\n",
+            "phase", "count", "ms", "minflt", "majflt", "utime ms",
+            "stime ms", "nvcsw", "nivcsw");
+    for (phase = 0; phase < CL_VM_NPHASES; ++phase) {
+        if (!vm->count[phase]) {
+            continue;
+        }
+        total = &vm->total[phase];
+        fprintf(file, "%-9s %6u %10.3f %9llu %7llu %9.3f %9.3f %7llu %7llu",
+                cl_vm_phases[phase], vm->count[phase],
+                total->v[CL_VM_NS] / 1e6,
+                (unsigned long long)total->v[CL_VM_MINFLT],
+                (unsigned long long)total->v[CL_VM_MAJFLT],
+                total->v[CL_VM_UTIME] / 1e3, total->v[CL_VM_STIME] / 1e3,
+                (unsigned long long)total->v[CL_VM_NVCSW],
+                (unsigned long long)total->v[CL_VM_NIVCSW]);
+        for (i = 0; i < CL_VM_NKEYS; ++i) {
+            if (total->v[CL_VM_VMSTAT + i]) {
+                fprintf(file, "  %s=%llu", cl_vm_keys[i],
+                        (unsigned long long)total->v[CL_VM_VMSTAT + i]);
+            }
+        }
+        fprintf(file, "\n");
+    }
+}
+
+static struct cl_vm *cl_vm_atexit_vm;
+
+static void cl_vm_atexit(void)
+{
+    if (cl_vm_atexit_vm) {
+        cl_vm_dump(cl_vm_atexit_vm, stdout);
+    }
+}
+
+/*
+ * With SVM_CL_PAGEMAP=1 the residency of the SVM ranges a phase works on is
+ * printed, see pagemap.h: after populating, before and after migrations and
+ * kernel runs, and after readback.
+ */
+static int cl_pagemap_enabled(void)
+{
+    const char *env = getenv("SVM_CL_PAGEMAP");
+
+    return env && strcmp(env, "0");
+}
+
+static void cl_program_pagemap(struct cl_program *clprog, const char *when,
+                               void *a, void *b, void *r)
+{
+    void *ptrs[3] = { a, b, r };
+    const char *names[3] = { "a", "b", "r" };
+    char label[64];
+    unsigned i, j;
+
+    if (!clprog->pagemap) {
+        return;
+    }
+    for (i = 0; i < 3; ++i) {
+        for (j = 0; j < i && ptrs[j] != ptrs[i]; ++j) {
+        }
+        if (ptrs[i] == NULL || j < i) {
+            continue;
+        }
+        snprintf(label, sizeof(label), "%s %s", when, names[i]);
+        pagemap_dump(stdout, label, ptrs[i], clprog->nwords * sizeof(int));
+    }
+}
+
+static const char *kernel =                                     "\n" \
+"__kernel void dumb(__global int *a,                             \n" \
+"                   __global int *b,                             \n" \
+"                   __global int *r,                             \n" \
+"                   const ulong n)                               \n" \
+"{                                                               \n" \
+"    size_t id = get_global_id(0);                               \n" \
+"    // Bounds check                                             \n" \
+"    if (id < n)                                                 \n" \
+"        r[id] = a[id] + b[id];                                  \n" \
+"}                                                               \n" \
+"                                                                \n" \
+"// Transposed walk, neighbours are stride words apart.          \n" \
+"__kernel void stride(__global int *a,                           \n" \
+"                     __global int *b,                           \n" \
+"                     __global int *r,                           \n" \
+"                     const ulong n,                             \n" \
+"                     const ulong stride)                        \n" \
+"{                                                               \n" \
+"    ulong id = get_global_id(0), rows = n / stride, j = id;     \n" \
+"    if (id >= n)                                                \n" \
+"        return;                                                 \n" \
+"    if (id < rows * stride)                                     \n" \
+"        j = id % rows * stride + id / rows;                     \n" \
+"    r[j] = a[j] + b[j];                                         \n" \
+"}                                                               \n" \
+"                                                                \n" \
+"// One word per step words, e.g. one touch per page.            \n" \
+"__kernel void page_stride(__global int *a,                      \n" \
+"                          __global int *b,                      \n" \
+"                          __global int *r,                      \n" \
+"                          const ulong n,                        \n" \
+"                          const ulong step)                     \n" \
+"{                                                               \n" \
+"    ulong j = get_global_id(0) * step;                          \n" \
+"    if (j < n)                                                  \n" \
+"        r[j] = a[j] + b[j];                                     \n" \
+"}                                                               \n" \
+"                                                                \n" \
+"// Bijection on [0, mask], mask + 1 a power of two.             \n" \
+"ulong scramble(ulong x, ulong mask, uint shift, ulong seed)     \n" \
+"{                                                               \n" \
+"    x = (x ^ seed) & mask;                                      \n" \
+"    x = (x * 0x9e3779b97f4a7c15UL) & mask;                      \n" \
+"    x ^= x >> shift;                                            \n" \
+"    x = (x * 0xbf58476d1ce4e5b9UL) & mask;                      \n" \
+"    x ^= x >> shift;                                            \n" \
+"    return x;                                                   \n" \
+"}                                                               \n" \
+"                                                                \n" \
+"// Seeded random order, cycle walked to stay a permutation.     \n" \
+"__kernel void gather(__global int *a,                           \n" \
+"                     __global int *b,                           \n" \
+"                     __global int *r,                           \n" \
+"                     const ulong n,                             \n" \
+"                     const ulong seed)                          \n" \
+"{                                                               \n" \
+"    ulong id = get_global_id(0), mask, j = 0;                   \n" \
+"    uint shift;                                                 \n" \
+"    if (id >= n)                                                \n" \
+"        return;                                                 \n" \
+"    if (n > 1) {                                                \n" \
+"        mask = ~0UL >> clz(n - 1);                              \n" \
+"        shift = (64 - clz(mask)) / 2 + 1;                       \n" \
+"        j = scramble(id, mask, shift, seed);                    \n" \
+"        while (j >= n)                                          \n" \
+"            j = scramble(j, mask, shift, seed);                 \n" \
+"    }                                                           \n" \
+"    r[j] = a[j] + b[j];                                         \n" \
+"}                                                               \n" \
+"                                                                \n" \
+"// 16x16 word tiles of a matrix with rows of width words.       \n" \
+"__kernel void tiled(__global int *a,                            \n" \
+"                    __global int *b,                            \n" \
+"                    __global int *r,                            \n" \
+"                    const ulong n,                              \n" \
+"                    const ulong width)                          \n" \
+"{                                                               \n" \
+"    ulong id = get_global_id(0), j = id, tile, t;               \n" \
+"    ulong tiles = width / 16;                                   \n" \
+"    if (id >= n)                                                \n" \
+"        return;                                                 \n" \
+"    if (id < n - n % (width * 16)) {                            \n" \
+"        tile = id / 256;                                        \n" \
+"        t = id % 256;                                           \n" \
+"        j = (tile / tiles * 16 + t / 16) * width +              \n" \
+"            tile % tiles * 16 + t % 16;                         \n" \
+"    }                                                           \n" \
+"    r[j] = a[j] + b[j];                                         \n" \
+"}                                                               \n";
+
+/*
+ * Program binary cache. Building the kernel from source is often the slowest
+ * part of a test, so the binary is kept on disk keyed by a hash of the
+ * platform, device, driver and kernel source, and loaded back instead of
+ * rebuilding. SVM_CL_CACHE=0 disables it, SVM_CL_CACHE_DIR overrides the
+ * default $XDG_CACHE_HOME/svm-cl-tests (or ~/.cache/svm-cl-tests).
+ */
+#define CL_CACHE_MAGIC "SVMCLBIN"
+
+struct cl_cache_header {
+    char magic[8];
+    uint64_t build_ns;
+    uint64_t size;
+};
+
+static uint64_t hash_fnv1a(uint64_t hash, const void *data, size_t size)
+{
+    const unsigned char *p = data;
+
+    while (size--) {
+        hash ^= *p++;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static int cl_cache_path(struct cl_program *clprog, char *path, size_t len)
+{
+    static const cl_platform_info platform_info[] = {
+        CL_PLATFORM_NAME, CL_PLATFORM_VERSION,
+    };
+    static const cl_device_info device_info[] = {
+        CL_DEVICE_NAME, CL_DEVICE_VERSION, CL_DRIVER_VERSION,
+    };
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    char buf[256], dir[PATH_MAX];
+    const char *env;
+    unsigned i;
+    cl_int res;
+
+    env = getenv("SVM_CL_CACHE");
+    if (env && !strcmp(env, "0")) {
+        return -1;
+    }
+
+    for (i = 0; i < sizeof(platform_info) / sizeof(platform_info[0]); ++i) {
+        res = clGetPlatformInfo(clprog->platform, platform_info[i],
+                                sizeof(buf), buf, NULL);
+        if (res != CL_SUCCESS) {
+            return -1;
+        }
+        hash = hash_fnv1a(hash, buf, strnlen(buf, sizeof(buf)));
+    }
+    for (i = 0; i < sizeof(device_info) / sizeof(device_info[0]); ++i) {
+        res = clGetDeviceInfo(clprog->device_id, device_info[i],
+                              sizeof(buf), buf, NULL);
+        if (res != CL_SUCCESS) {
+            return -1;
+        }
+        hash = hash_fnv1a(hash, buf, strnlen(buf, sizeof(buf)));
+    }
+    hash = hash_fnv1a(hash, kernel, strlen(kernel));
+
+    if ((env = getenv("SVM_CL_CACHE_DIR"))) {
+        snprintf(dir, sizeof(dir), "%s", env);
+    } else if ((env = getenv("XDG_CACHE_HOME"))) {
+        snprintf(dir, sizeof(dir), "%s/svm-cl-tests", env);
+    } else if ((env = getenv("HOME"))) {
+        snprintf(dir, sizeof(dir), "%s/.cache", env);
+        mkdir(dir, 0755);
+        snprintf(dir, sizeof(dir), "%s/.cache/svm-cl-tests", env);
+    } else {
+        return -1;
+    }
+    if (mkdir(dir, 0755) && errno != EEXIST) {
+        return -1;
+    }
+
+    snprintf(path, len, "%s/%016llx.bin", dir, (unsigned long long)hash);
+    return 0;
+}
+
+/*
+ * Create and build clprog->program from the cached binary. Returns the
+ * source build time recorded with it, or 0 if there is no usable entry.
+ */
+static uint64_t cl_cache_load(struct cl_program *clprog, const char *path)
+{
+    const unsigned char *binaries[1];
+    struct cl_cache_header header;
+    unsigned char *binary;
+    cl_int res, status;
+    size_t size;
+    FILE *file;
+
+    file = fopen(path, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+    if (fread(&header, sizeof(header), 1, file) != 1 ||
+        memcmp(header.magic, CL_CACHE_MAGIC, sizeof(header.magic)) ||
+        !header.size) {
+        fclose(file);
+        return 0;
+    }
+    size = header.size;
+    binary = malloc(size);
+    if (binary == NULL || fread(binary, size, 1, file) != 1) {
+        free(binary);
+        fclose(file);
+        return 0;
+    }
+    fclose(file);
+
+    binaries[0] = binary;
+    clprog->program = clCreateProgramWithBinary(clprog->context, 1,
+                                                &clprog->device_id, &size,
+                                                binaries, &status, &res);
+    free(binary);
+    if (res != CL_SUCCESS) {
+        return 0;
+    }
+    res = clBuildProgram(clprog->program, 0, NULL, NULL, NULL, NULL);
+    if (status != CL_SUCCESS || res != CL_SUCCESS) {
+        clReleaseProgram(clprog->program);
+        return 0;
+    }
+
+    return header.build_ns ? header.build_ns : 1;
+}
+
+static void cl_cache_store(struct cl_program *clprog, const char *path,
+                           uint64_t build_ns)
+{
+    struct cl_cache_header header;
+    char tmp[PATH_MAX + 16];
+    unsigned char *binary;
+    size_t size;
+    cl_int res;
+    FILE *file;
+
+    res = clGetProgramInfo(clprog->program, CL_PROGRAM_BINARY_SIZES,
+                           sizeof(size), &size, NULL);
+    if (res != CL_SUCCESS || !size) {
+        return;
+    }
+    binary = malloc(size);
+    if (binary == NULL) {
+        return;
+    }
+    res = clGetProgramInfo(clprog->program, CL_PROGRAM_BINARIES,
+                           sizeof(binary), &binary, NULL);
+    if (res != CL_SUCCESS) {
+        free(binary);
+        return;
+    }
+
+    memcpy(header.magic, CL_CACHE_MAGIC, sizeof(header.magic));
+    header.build_ns = build_ns;
+    header.size = size;
+
+    /* Write aside and rename so concurrent tests never read a torn file. */
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, getpid());
+    file = fopen(tmp, "wb");
+    if (file == NULL) {
+        free(binary);
+        return;
+    }
+    if (fwrite(&header, sizeof(header), 1, file) != 1 ||
+        fwrite(binary, size, 1, file) != 1) {
+        fclose(file);
+        unlink(tmp);
+    } else if (fclose(file) || rename(tmp, path)) {
+        unlink(tmp);
+    }
+    free(binary);
+}
+
+static int cl_program_build(struct cl_program *clprog)
+{
+    uint64_t start, saved, build_ns;
+    char path[PATH_MAX];
+    int cache;
+    cl_int res;
+
+    cache = !cl_cache_path(clprog, path, sizeof(path));
+    start = time_ns();
+    if (cache && (saved = cl_cache_load(clprog, path))) {
+        build_ns = time_ns() - start;
+        printf("program cache hit, load %.3f ms, build time saved %.3f ms\n",
+               build_ns / 1e6, ((int64_t)saved - (int64_t)build_ns) / 1e6);
+        return 0;
     }
 
     clprog->program = clCreateProgramWithSource(clprog->context, 1,
                                                (const char **)&kernel,
                                                NULL, &res);
     if (res != CL_SUCCESS) {
-        goto error_program;
+        return -1;
     }
     res = clBuildProgram(clprog->program, 0, NULL, NULL, NULL, NULL);
     if (res != CL_SUCCESS) {
-        goto error_build;
+        clReleaseProgram(clprog->program);
+        return -1;
+    }
+    build_ns = time_ns() - start;
+
+    if (cache) {
+        printf("program cache miss, build %.3f ms\n", build_ns / 1e6);
+        cl_cache_store(clprog, path, build_ns);
+    }
+    return 0;
+}
+
+/*
+ * Parse a "name[:param]" kernel selection, param with an optional K, M or G
+ * suffix and rounded up to what the kernel needs. NULL or "" is dumb.
+ */
+static int cl_kernel_parse(const char *spec, enum cl_kernel_id *id,
+                           cl_ulong *param)
+{
+    size_t len;
+    unsigned i;
+
+    if (spec == NULL || *spec == '\0') {
+        spec = "dumb";
+    }
+    len = strcspn(spec, ":");
+    for (i = 0; i < CL_NKERNELS; ++i) {
+        if (strlen(cl_kernels[i].name) != len ||
+            strncmp(spec, cl_kernels[i].name, len)) {
+            continue;
+        }
+        *id = i;
+        *param = spec[len] ? parse_size(spec + len + 1) : cl_kernels[i].param;
+        switch (*id) {
+        case CL_KERNEL_STRIDE:
+            *param = *param ? *param : 1;
+            break;
+        case CL_KERNEL_PAGE_STRIDE:
+            *param = ALIGN(*param ? *param : 1, sizeof(int32_t));
+            break;
+        case CL_KERNEL_TILED:
+            *param = ALIGN(*param ? *param : 1, 16);
+            break;
+        default:
+            break;
+        }
+        return 0;
+    }
+    return -1;
+}
+
+/* Platform, device, context, queue and the built kernel. */
+static int cl_context_init(struct cl_program *clprog)
+{
+    cl_queue_properties props[] = {
+        CL_QUEUE_PROPERTIES, CL_QUEUE_PROFILING_ENABLE, 0
+    };
+    cl_int res;
+
+    res = clGetPlatformIDs(1, &clprog->platform, NULL);
+    if (res != CL_SUCCESS) {
+        return -1;
+    }
+
+    res = clGetDeviceIDs(clprog->platform, CL_DEVICE_TYPE_GPU,
+                         1, &clprog->device_id, NULL);
+    if (res != CL_SUCCESS) {
+        return -1;
+    }
+
+    clprog->context = clCreateContext(0, 1, &clprog->device_id,
+                                     NULL, NULL, &res);
+    if (res != CL_SUCCESS) {
+        return -1;
+    }
+    clprog->queue = clCreateCommandQueueWithProperties(clprog->context,
+                                                       clprog->device_id,
+                                                       cl_prof_enabled() ?
+                                                       props : NULL, &res);
+    if (res != CL_SUCCESS) {
+        goto error_queue;
+    }
+
+    if (cl_program_build(clprog)) {
+        goto error_program;
+    }
+    if (cl_kernel_parse(getenv("SVM_CL_KERNEL"), &clprog->kernel_id,
+                        &clprog->kernel_param)) {
+        fprintf(stderr, "SVM_CL_KERNEL: unknown kernel %s\n",
+                getenv("SVM_CL_KERNEL"));
+        goto error_kernel;
+    }
+    clprog->kernel = clCreateKernel(clprog->program,
+                                    cl_kernels[clprog->kernel_id].entry, &res);
+    if (res != CL_SUCCESS) {
+        goto error_kernel;
+    }
+
+    return 0;
+
+error_kernel:
+    clReleaseProgram(clprog->program);
+error_program:
+    clReleaseCommandQueue(clprog->queue);
+error_queue:
+    clReleaseContext(clprog->context);
+
+    return -1;
+}
+
+static void cl_context_fini(struct cl_program *clprog)
+{
+    clReleaseKernel(clprog->kernel);
+    clReleaseProgram(clprog->program);
+    clReleaseCommandQueue(clprog->queue);
+    clReleaseContext(clprog->context);
+}
+
+static int cl_program_init(struct cl_program *clprog, size_t nwords)
+{
+    struct cl_vm_sample start;
+
+    clprog->nwords = nwords;
+    clprog->prof = cl_prof_enabled() ? calloc(1, sizeof(*clprog->prof)) : NULL;
+    clprog->vm = cl_vm_enabled() ? calloc(1, sizeof(*clprog->vm)) : NULL;
+    clprog->pagemap = cl_pagemap_enabled();
+    cl_vm_begin(clprog, &start);
+    clprog->mem_a = clprog->mem_b = clprog->mem_r = NULL;
+    clprog->r = clprog->out = NULL;
+    clprog->kernel_ns = clprog->readback_ns = 0;
+
+#ifdef SVM_CL_SUITE
+    clprog->platform = cl_suite.base->platform;
+    clprog->device_id = cl_suite.base->device_id;
+    clprog->context = cl_suite.base->context;
+    clprog->queue = cl_suite.base->queue;
+    clprog->program = cl_suite.base->program;
+    clprog->kernel = cl_suite.base->kernel;
+    clprog->kernel_id = cl_suite.base->kernel_id;
+    clprog->kernel_param = cl_suite.base->kernel_param;
+    cl_suite.current = clprog;
+#else
+    if (cl_context_init(clprog)) {
+        cl_prof_free(clprog->prof);
+        free(clprog->vm);
+        return -1;
+    }
+    if (clprog->prof && cl_prof_atexit_prof == NULL) {
+        cl_prof_atexit_prof = clprog->prof;
+        atexit(cl_prof_atexit);
+    }
+    if (clprog->vm && cl_vm_atexit_vm == NULL) {
+        cl_vm_atexit_vm = clprog->vm;
+        atexit(cl_vm_atexit);
+    }
+#endif
+    cl_vm_end(clprog, CL_VM_INIT, &start);
+    return 0;
+}
+
+/* Drop the kernel in use, unless it is the one the suite shares. */
+static void cl_program_kernel_put(struct cl_program *clprog)
+{
+#ifdef SVM_CL_SUITE
+    if (clprog->kernel == cl_suite.base->kernel) {
+        return;
+    }
+#endif
+    clReleaseKernel(clprog->kernel);
+}
+
+/*
+ * Select the kernel for the following runs, "name[:param]" as parsed by
+ * cl_kernel_parse(). The default comes from SVM_CL_KERNEL.
+ */
+static int cl_program_select(struct cl_program *clprog, const char *spec)
+{
+    enum cl_kernel_id id;
+    cl_kernel kernel;
+    cl_ulong param;
+    cl_int res;
+
+    if (cl_kernel_parse(spec, &id, &param)) {
+        return -1;
+    }
+    if (id != clprog->kernel_id) {
+        kernel = clCreateKernel(clprog->program, cl_kernels[id].entry, &res);
+        if (res != CL_SUCCESS) {
+            return -1;
+        }
+        cl_program_kernel_put(clprog);
+        clprog->kernel = kernel;
+        clprog->kernel_id = id;
+    }
+    clprog->kernel_param = param;
+    return 0;
+}
+
+/*
+ * For tests that check every word of r themselves: keep the selected kernel
+ * unless it skips words (page-stride), then fall back to dumb.
+ */
+static int cl_program_select_full(struct cl_program *clprog)
+{
+    if (clprog->kernel_id != CL_KERNEL_PAGE_STRIDE) {
+        return 0;
+    }
+    return cl_program_select(clprog, "dumb");
+}
+
+/*
+ * Standalone tests just exit and let the process teardown release this, the
+ * suite runner calls it after each scenario.
+ */
+static void cl_program_fini(struct cl_program *clprog)
+{
+    if (clprog->prof) {
+        cl_prof_dump(clprog->prof, stdout);
+        if (cl_prof_atexit_prof == clprog->prof) {
+            cl_prof_atexit_prof = NULL;
+        }
+        cl_prof_free(clprog->prof);
+    }
+    if (clprog->vm) {
+        cl_vm_dump(clprog->vm, stdout);
+        if (cl_vm_atexit_vm == clprog->vm) {
+            cl_vm_atexit_vm = NULL;
+        }
+        free(clprog->vm);
+    }
+    if (clprog->mem_r) {
+        clReleaseMemObject(clprog->mem_r);
+    }
+    if (clprog->mem_b) {
+        clReleaseMemObject(clprog->mem_b);
+    }
+    if (clprog->mem_a) {
+        clReleaseMemObject(clprog->mem_a);
+    }
+#ifdef SVM_CL_SUITE
+    cl_program_kernel_put(clprog);
+#else
+    cl_context_fini(clprog);
+#endif
+    free(clprog->r);
+}
+
+/*
+ * The kernel arguments, in kernel argument order. Each has a fixed initial
+ * content, word i = base + i * step, see cl_program_fill().
+ */
+enum cl_arg {
+    CL_ARG_A,
+    CL_ARG_B,
+    CL_ARG_R,
+};
+
+static const struct {
+    int32_t base;
+    int32_t step;
+} cl_arg_pattern[] = {
+    [CL_ARG_A] = { 0, 1 },
+    [CL_ARG_B] = { 0, -1 },
+    [CL_ARG_R] = { 0xcafedead, 0 },
+};
+
+/* Fill nwords words at ptr with the initial content of argument arg. */
+static void cl_program_fill(struct cl_program *clprog, void *ptr,
+                            enum cl_arg arg)
+{
+    void *ptrs[3] = { NULL, NULL, NULL };
+    struct cl_vm_sample start;
+
+    cl_vm_begin(clprog, &start);
+    fill_linear(ptr, clprog->nwords, cl_arg_pattern[arg].base,
+                cl_arg_pattern[arg].step);
+    cl_vm_end(clprog, CL_VM_POPULATE, &start);
+    ptrs[arg] = ptr;
+    cl_program_pagemap(clprog, "populated", ptrs[0], ptrs[1], ptrs[2]);
+}
+
+/*
+ * The cl_mem fallback for argument arg, created and filled on first use so
+ * runs that pass SVM pointers for everything never allocate device memory
+ * or upload anything for it. Returns NULL on failure.
+ */
+static cl_mem cl_program_buffer(struct cl_program *clprog, enum cl_arg arg)
+{
+    cl_mem *mem = arg == CL_ARG_A ? &clprog->mem_a :
+                  arg == CL_ARG_B ? &clprog->mem_b : &clprog->mem_r;
+    size_t size = clprog->nwords * sizeof(int32_t);
+    cl_event event;
+    void *ptr;
+    cl_int res;
+
+    if (*mem) {
+        return *mem;
+    }
+
+    *mem = clCreateBuffer(clprog->context, arg == CL_ARG_R ?
+                          CL_MEM_WRITE_ONLY : CL_MEM_READ_ONLY,
+                          size, NULL, &res);
+    if (res != CL_SUCCESS) {
+        goto error_buffer;
+    }
+    ptr = clEnqueueMapBuffer(clprog->queue, *mem, CL_TRUE,
+                             CL_MAP_WRITE_INVALIDATE_REGION, 0, size,
+                             0, NULL, NULL, &res);
+    if (res != CL_SUCCESS) {
+        goto error_map;
+    }
+    fill_linear(ptr, clprog->nwords, cl_arg_pattern[arg].base,
+                cl_arg_pattern[arg].step);
+    res = clEnqueueUnmapMemObject(clprog->queue, *mem, ptr, 0, NULL, &event);
+    if (res != CL_SUCCESS) {
+        goto error_map;
     }
-    clprog->kernel = clCreateKernel(clprog->program, "dumb", &res);
+    res = clWaitForEvents(1, &event);
     if (res != CL_SUCCESS) {
-        goto error_kernel;
+        clReleaseEvent(event);
+        goto error_map;
     }
+    cl_prof_record(clprog, "write", event);
 
-    clprog->mem_a = clCreateBuffer(clprog->context, CL_MEM_READ_ONLY,
-                                   size, NULL, &res);
-    if (res != CL_SUCCESS) {
-        goto error_buffer_a;
+    return *mem;
+
+error_map:
+    clReleaseMemObject(*mem);
+error_buffer:
+    *mem = NULL;
+    return NULL;
+}
+
+/* Bind argument arg to SVM pointer ptr, or to its cl_mem if ptr is NULL. */
+static int cl_program_set_arg(struct cl_program *clprog, enum cl_arg arg,
+                              void *ptr)
+{
+    cl_mem mem;
+    cl_int res;
+
+    if (ptr) {
+        res = clSetKernelArgSVMPointer(clprog->kernel, arg, ptr);
+        return res == CL_SUCCESS ? 0 : -1;
     }
-    clprog->mem_b = clCreateBuffer(clprog->context, CL_MEM_READ_ONLY,
-                                   size, NULL, &res);
-    if (res != CL_SUCCESS) {
-        goto error_buffer_b;
+
+    mem = cl_program_buffer(clprog, arg);
+    if (mem == NULL) {
+        return -1;
     }
-    clprog->mem_r = clCreateBuffer(clprog->context, CL_MEM_WRITE_ONLY,
-                                   size, NULL, &res);
-    if (res != CL_SUCCESS) {
-        goto error_buffer_r;
+    res = clSetKernelArg(clprog->kernel, arg, sizeof(cl_mem), &mem);
+    return res == CL_SUCCESS ? 0 : -1;
+}
+
+/* Work items of the selected kernel, one per word it computes. */
+static size_t cl_program_items(struct cl_program *clprog)
+{
+    size_t step;
+
+    if (clprog->kernel_id != CL_KERNEL_PAGE_STRIDE) {
+        return clprog->nwords;
     }
+    step = clprog->kernel_param / sizeof(int32_t);
+    return (clprog->nwords + step - 1) / step;
+}
 
-    res = clEnqueueWriteBuffer(clprog->queue, clprog->mem_a, CL_TRUE,
-                               0, size, clprog->a, 0, NULL, NULL);
-    if (res != CL_SUCCESS) {
-        goto error_write_a;
+/*
+ * Enqueue the kernel without waiting for it. SVM pointers that are NULL use
+ * the program cl_mem buffers instead, see cl_program_buffer(). The kernel
+ * starts after the nwait events in wait have completed, and *event (if not
+ * NULL) is the caller's to wait on and release, so runs and migrations can
+ * be chained on the device without a host round trip in between.
+ */
+static int cl_program_enqueue(struct cl_program *clprog, void *a, void *b,
+                              void *r, cl_uint nwait, const cl_event *wait,
+                              cl_event *event)
+{
+    size_t global_size, local_size, items;
+    cl_ulong n, param;
+    cl_int res;
+
+    if (cl_program_set_arg(clprog, CL_ARG_A, a) ||
+        cl_program_set_arg(clprog, CL_ARG_B, b) ||
+        cl_program_set_arg(clprog, CL_ARG_R, r)) {
+        return -1;
     }
-    res = clEnqueueWriteBuffer(clprog->queue, clprog->mem_b, CL_TRUE,
-                               0, size, clprog->b, 0, NULL, NULL);
+    n = clprog->nwords;
+    res = clSetKernelArg(clprog->kernel, 3, sizeof(n), &n);
     if (res != CL_SUCCESS) {
-        goto error_write_b;
+        return -1;
     }
-    res = clEnqueueWriteBuffer(clprog->queue, clprog->mem_r, CL_TRUE,
-                               0, size, clprog->r, 0, NULL, &event);
-    if (res != CL_SUCCESS) {
-        goto error_write_r;
+    items = cl_program_items(clprog);
+    if (clprog->kernel_id != CL_KERNEL_DUMB) {
+        param = clprog->kernel_param;
+        if (clprog->kernel_id == CL_KERNEL_PAGE_STRIDE) {
+            param /= sizeof(int32_t);
+        }
+        res = clSetKernelArg(clprog->kernel, 4, sizeof(param), &param);
+        if (res != CL_SUCCESS) {
+            return -1;
+        }
     }
 
-    res = clWaitForEvents(1, &event);
+    local_size = 64;
+    global_size = ALIGN(items, local_size);
+    res = clEnqueueNDRangeKernel(clprog->queue, clprog->kernel, 1,
+                                 NULL, &global_size, &local_size,
+                                 nwait, wait, event);
     if (res != CL_SUCCESS) {
-        goto error_wait;
+        return -1;
     }
 
     return 0;
+}
 
-error_wait:
-error_write_r:
-error_write_b:
-error_write_a:
-error_buffer_r:
-    clReleaseMemObject(clprog->mem_b);
-error_buffer_b:
-    clReleaseMemObject(clprog->mem_a);
-error_buffer_a:
-    clReleaseKernel(clprog->kernel);
-error_build:
-error_kernel:
-    clReleaseProgram(clprog->program);
-error_program:
-    clReleaseCommandQueue(clprog->queue);
-error_queue:
-    clReleaseContext(clprog->context);
+/* A range to migrate, of any alignment and size. */
+struct cl_range {
+    void *ptr;
+    size_t size;
+};
 
-    return -1;
+/* Ranges merged on the stack, more than that are merged in a malloc(). */
+#define CL_RANGES_STACK 16
+
+static int cl_range_cmp(const void *pa, const void *pb)
+{
+    const struct cl_range *a = pa, *b = pb;
+
+    return a->ptr < b->ptr ? -1 : a->ptr > b->ptr;
 }
 
-static int cl_program_run_nocheck(struct cl_program *clprog, void *a, void *b, void *r)
+/*
+ * Enqueue migration of n ranges in a single clEnqueueSVMMigrateMem() call,
+ * without waiting for it. Each range is widened to whole pages, then they
+ * are sorted and the ones that overlap or touch after rounding merged, so
+ * every page is passed to the driver once. Empty ranges are dropped; if
+ * nothing is left a marker stands in for the migration. flags are the
+ * CL_MIGRATE_MEM_OBJECT_* flags, 0 migrates to the device. Same wait list
+ * and event rules as cl_program_enqueue().
+ */
+static int cl_program_migrate_ranges_async(struct cl_program *clprog,
+                                           const struct cl_range *ranges,
+                                           unsigned n,
+                                           cl_mem_migration_flags flags,
+                                           cl_uint nwait, const cl_event *wait,
+                                           cl_event *event)
 {
-    size_t global_size, local_size;
-    cl_event event;
+    struct cl_range stack_ranges[CL_RANGES_STACK], *merged = stack_ranges;
+    const void *stack_ptrs[CL_RANGES_STACK], **ptrs = stack_ptrs;
+    size_t stack_sizes[CL_RANGES_STACK], *sizes = stack_sizes;
+    uintptr_t start, end, last;
+    unsigned i, count = 0;
+    int ret = -1;
     cl_int res;
 
-    if (a) {
-        res  = clSetKernelArgSVMPointer(clprog->kernel, 0, a);
-        if (res != CL_SUCCESS) {
-            return -1;
+    if (n > CL_RANGES_STACK) {
+        merged = malloc(n * sizeof(*merged));
+        ptrs = malloc(n * sizeof(*ptrs));
+        sizes = malloc(n * sizeof(*sizes));
+        if (merged == NULL || ptrs == NULL || sizes == NULL) {
+            goto out;
         }
-    } else {
-        res = clSetKernelArg(clprog->kernel, 0, sizeof(cl_mem), &clprog->mem_a);
-        if (res != CL_SUCCESS) {
-            return -1;
+    }
+
+    for (i = 0; i < n; ++i) {
+        if (!ranges[i].size) {
+            continue;
         }
+        start = (uintptr_t)ranges[i].ptr & ~0xFFFUL;
+        end = ALIGN((uintptr_t)ranges[i].ptr + ranges[i].size, 1 << 12);
+        merged[count].ptr = (void *)start;
+        merged[count].size = end - start;
+        count++;
     }
-    if (b) {
-        res  = clSetKernelArgSVMPointer(clprog->kernel, 1, b);
-        if (res != CL_SUCCESS) {
-            return -1;
+    if (count > 1) {
+        qsort(merged, count, sizeof(*merged), cl_range_cmp);
+    }
+
+    n = count;
+    count = 0;
+    for (i = 0; i < n; ++i) {
+        start = (uintptr_t)merged[i].ptr;
+        end = start + merged[i].size;
+        if (count && start <= (last = (uintptr_t)ptrs[count - 1] +
+                                      sizes[count - 1])) {
+            if (end > last) {
+                sizes[count - 1] += end - last;
+            }
+            continue;
         }
+        ptrs[count] = merged[i].ptr;
+        sizes[count] = merged[i].size;
+        count++;
+    }
+
+    if (count) {
+        res = clEnqueueSVMMigrateMem(clprog->queue, count, ptrs, sizes,
+                                     flags, nwait, wait, event);
     } else {
-        res = clSetKernelArg(clprog->kernel, 1, sizeof(cl_mem), &clprog->mem_b);
-        if (res != CL_SUCCESS) {
-            return -1;
-        }
+        res = clEnqueueMarkerWithWaitList(clprog->queue, nwait, wait, event);
     }
-    if (r) {
-        res  = clSetKernelArgSVMPointer(clprog->kernel, 2, r);
-        if (res != CL_SUCCESS) {
-            return -1;
+    ret = res == CL_SUCCESS ? 0 : -1;
+out:
+    if (merged != stack_ranges) {
+        free(merged);
+        free(ptrs);
+        free(sizes);
+    }
+    return ret;
+}
+
+/* The same for the single range [mem, mem + size). */
+static int cl_program_migrate_async(struct cl_program *clprog, void *mem,
+                                    size_t size, cl_mem_migration_flags flags,
+                                    cl_uint nwait, const cl_event *wait,
+                                    cl_event *event)
+{
+    struct cl_range range = { mem, size };
+
+    return cl_program_migrate_ranges_async(clprog, &range, 1, flags,
+                                           nwait, wait, event);
+}
+
+/*
+ * Make the output of the last run readable by the host. A cl_mem output is
+ * read back into clprog->r, allocated on first use. An SVM output is
+ * touched once per page, so pages left on the device fault back here
+ * through the CPU fault path and not during verification, then checked in
+ * place without a copy. Callers that want an explicit migration instead
+ * call cl_program_migrate_host() first. Afterwards clprog->out points at
+ * the result.
+ */
+static int cl_program_readback(struct cl_program *clprog, void *r)
+{
+    size_t i, size = clprog->nwords * sizeof(int);
+    volatile int *p = r;
+    cl_event event;
+    cl_int res;
+
+    if (r == NULL) {
+        if (clprog->r == NULL) {
+            clprog->r = malloc(size);
+            if (clprog->r == NULL) {
+                return -1;
+            }
         }
-    } else {
-        res = clSetKernelArg(clprog->kernel, 2, sizeof(cl_mem), &clprog->mem_r);
+        res = clEnqueueReadBuffer(clprog->queue, clprog->mem_r, CL_TRUE, 0,
+                                  size, clprog->r, 0, NULL, &event);
         if (res != CL_SUCCESS) {
             return -1;
         }
+        cl_prof_record(clprog, "read", event);
+        clprog->out = clprog->r;
+        return 0;
     }
-    res = clSetKernelArg(clprog->kernel, 3, sizeof(unsigned), &clprog->nwords);
-    if (res != CL_SUCCESS) {
-        return -1;
+
+    for (i = 0; i < clprog->nwords; i += (1 << 12) / sizeof(int)) {
+        (void)p[i];
+    }
+    if (clprog->nwords) {
+        (void)p[clprog->nwords - 1];
     }
+    clprog->out = r;
 
+    return 0;
+}
 
-    local_size = 64;
-    global_size = ceil(clprog->nwords / (float)local_size) * local_size;
-    res = clEnqueueNDRangeKernel(clprog->queue, clprog->kernel, 1,
-                                 NULL, &global_size, &local_size,
-                                 0, NULL, &event);
-    clFinish(clprog->queue);
+/*
+ * Run the kernel then read the result back, kernel_ns and readback_ns hold
+ * the time spent in each phase.
+ */
+static int cl_program_run_nocheck(struct cl_program *clprog, void *a, void *b, void *r)
+{
+    struct cl_vm_sample start;
+    cl_event event;
+    cl_int res;
+    uint64_t t;
+
+    if (clprog->prof) {
+        clprog->prof->run++;
+    }
+
+    /*
+     * Bind before timing, so creating and uploading a cl_mem on first use
+     * is not charged to the kernel.
+     */
+    if (cl_program_set_arg(clprog, CL_ARG_A, a) ||
+        cl_program_set_arg(clprog, CL_ARG_B, b) ||
+        cl_program_set_arg(clprog, CL_ARG_R, r)) {
+        return -1;
+    }
+
+    cl_program_pagemap(clprog, "kernel before", a, b, r);
+    cl_vm_begin(clprog, &start);
+    t = time_ns();
+    if (cl_program_enqueue(clprog, a, b, r, 0, NULL, &event)) {
+        return -1;
+    }
     res = clWaitForEvents(1, &event);
     if (res != CL_SUCCESS) {
+        clReleaseEvent(event);
         return -1;
     }
+    cl_prof_record(clprog, "kernel", event);
+    clprog->kernel_ns = time_ns() - t;
+    cl_vm_end(clprog, CL_VM_KERNEL, &start);
+    cl_program_pagemap(clprog, "kernel after", a, b, r);
 
-    if (r) {
-        memcpy(clprog->r, r, clprog->nwords * sizeof(int));
-    } else {
-        clEnqueueReadBuffer(clprog->queue, clprog->mem_r, CL_TRUE, 0,
-                            clprog->nwords * sizeof(int), clprog->r,
-                            0, NULL, &event);
-        clFinish(clprog->queue);
-        res = clWaitForEvents(1, &event);
-        if (res != CL_SUCCESS) {
-            return -1;
-        }
+    cl_vm_begin(clprog, &start);
+    t = time_ns();
+    if (cl_program_readback(clprog, r)) {
+        return -1;
     }
+    clprog->readback_ns = time_ns() - t;
+    cl_vm_end(clprog, CL_VM_READBACK, &start);
+    cl_program_pagemap(clprog, "readback", NULL, NULL, r);
 
     return 0;
 }
 
+/*
+ * Check a result of the selected kernel on the a and b patterns: zero in
+ * every word it computed. For page-stride only those words are checked.
+ */
+static int cl_program_verify(struct cl_program *clprog, const int *out,
+                             size_t *bad)
+{
+    struct cl_vm_sample start;
+    size_t i, step;
+    int ret = 0;
+
+    cl_vm_begin(clprog, &start);
+    if (clprog->kernel_id != CL_KERNEL_PAGE_STRIDE) {
+        ret = verify_zero(out, clprog->nwords, bad);
+    } else {
+        step = clprog->kernel_param / sizeof(int32_t);
+        for (i = 0; i < clprog->nwords; i += step) {
+            if (out[i]) {
+                if (bad) {
+                    *bad = i;
+                }
+                ret = -1;
+                break;
+            }
+        }
+    }
+    cl_vm_end(clprog, CL_VM_VERIFY, &start);
+    return ret;
+}
+
 static int cl_program_run(struct cl_program *clprog, void *a, void *b, void *r)
 {
-    unsigned i;
     int ret = cl_program_run_nocheck(clprog, a, b, r);
 
     if (ret)
         return ret;
 
-    for (i = 0; i < clprog->nwords; ++i) {
-        if (clprog->r[i]) {
-            return -1;
-        }
+    return cl_program_verify(clprog, clprog->out, NULL);
+}
+
+/*
+ * Migrate the nwords at mem with flags and wait for it, what names the
+ * migration in the profile and the pagemap dumps.
+ */
+static int cl_program_migrate_flags(struct cl_program *clprog, void *mem,
+                                    cl_mem_migration_flags flags,
+                                    const char *what)
+{
+    struct cl_vm_sample start;
+    char label[32];
+    cl_event event;
+    cl_int res;
+
+    snprintf(label, sizeof(label), "%s before", what);
+    cl_program_pagemap(clprog, label, mem, NULL, NULL);
+    cl_vm_begin(clprog, &start);
+    if (cl_program_migrate_async(clprog, mem, clprog->nwords * sizeof(int),
+                                 flags, 0, NULL, &event)) {
+        return -1;
     }
 
+    res = clWaitForEvents(1, &event);
+    if (res != CL_SUCCESS) {
+        clReleaseEvent(event);
+        return -1;
+    }
+    cl_prof_record(clprog, what, event);
+    cl_vm_end(clprog, CL_VM_MIGRATE, &start);
+    snprintf(label, sizeof(label), "%s after", what);
+    cl_program_pagemap(clprog, label, mem, NULL, NULL);
+
     return 0;
 }
 
 static int cl_program_migrate(struct cl_program *clprog, void *mem)
 {
-    const void *ptrs[1];
+    return cl_program_migrate_flags(clprog, mem, 0, "migrate");
+}
+
+/*
+ * Migrate the nwords at mem back to system memory and wait for it, rather
+ * than letting the host fault the pages back one at a time on first touch.
+ */
+static int cl_program_migrate_host(struct cl_program *clprog, void *mem)
+{
+    return cl_program_migrate_flags(clprog, mem, CL_MIGRATE_MEM_OBJECT_HOST,
+                                    "migrate-host");
+}
+
+/*
+ * Migrate the nwords at mem to the device without their content, for an
+ * output the kernel overwrites entirely. Until the kernel writes them the
+ * words are undefined, though a driver is free to copy them anyway.
+ */
+static int cl_program_migrate_discard(struct cl_program *clprog, void *mem)
+{
+    return cl_program_migrate_flags(clprog, mem,
+                                    CL_MIGRATE_MEM_OBJECT_CONTENT_UNDEFINED,
+                                    "migrate-discard");
+}
+
+/* Migrate n ranges to the device in one call and wait for it. */
+static int cl_program_migrate_ranges(struct cl_program *clprog,
+                                     const struct cl_range *ranges,
+                                     unsigned n)
+{
+    struct cl_vm_sample start;
     cl_event event;
-    size_t size;
     cl_int res;
 
-    ptrs[0] = (void *)((uintptr_t)mem & ~0xFFFUL);
-    size = clprog->nwords * sizeof(int);
-    size = ALIGN(size, 1 << 12);
-    res = clEnqueueSVMMigrateMem(clprog->queue, 1, ptrs, &size,
-                                 0, 0, NULL, &event);
-    if (res != CL_SUCCESS) {
+    cl_vm_begin(clprog, &start);
+    if (cl_program_migrate_ranges_async(clprog, ranges, n, 0, 0, NULL,
+                                        &event)) {
         return -1;
     }
 
     res = clWaitForEvents(1, &event);
+    if (res != CL_SUCCESS) {
+        clReleaseEvent(event);
+        return -1;
+    }
+    cl_prof_record(clprog, "migrate", event);
+    cl_vm_end(clprog, CL_VM_MIGRATE, &start);
+
+    return 0;
+}
+
+/*
+ * Pool of same size regions from mem_anon_map() or hugefs_alloc() that are
+ * recycled instead of unmapped, so runs after the first see memory that is
+ * already faulted in, as a long running process would. What put does to a
+ * region before it goes back on the free list:
+ *   keep        nothing, contents and residency stay as the user left them
+ *   dontneed    MADV_DONTNEED, the next user faults in zero pages again
+ *   zero        memset() to zero, pages stay (or come back) in host memory
+ * With resident set, put then migrates the region to that program's device
+ * so the next get hands out device resident memory.
+ */
+#define MEM_POOL_MAX    64
+
+enum mem_pool_reset {
+    MEM_POOL_KEEP,
+    MEM_POOL_DONTNEED,
+    MEM_POOL_ZERO,
+    MEM_POOL_NRESETS,
+};
+
+struct mem_pool {
+    size_t size;
+    int huge;
+    enum mem_pool_reset reset;
+    struct cl_program *resident;
+    unsigned nfree;
+    void *free[MEM_POOL_MAX];
+    unsigned long hits;
+    unsigned long misses;
+};
+
+static void mem_pool_init(struct mem_pool *pool, size_t size, int huge,
+                          enum mem_pool_reset reset,
+                          struct cl_program *resident)
+{
+    memset(pool, 0, sizeof(*pool));
+    pool->size = size;
+    pool->huge = huge;
+    pool->reset = reset;
+    pool->resident = resident;
+}
+
+static void mem_pool_unmap(struct mem_pool *pool, void *ptr)
+{
+    if (pool->huge) {
+        hugefs_free(ptr);
+    } else {
+        mem_unmap(ptr, pool->size);
+    }
+}
+
+static void *mem_pool_get(struct mem_pool *pool)
+{
+    if (pool->nfree) {
+        pool->hits++;
+        return pool->free[--pool->nfree];
+    }
+    pool->misses++;
+    return pool->huge ? hugefs_alloc(pool->size) : mem_anon_map(pool->size);
+}
+
+/*
+ * Reset and recycle ptr, unmapped instead when the free list is full.
+ * Returns 1 if the backing does not support the reset (MADV_DONTNEED on
+ * hugetlbfs before Linux 5.18), -1 if migrating fails, ptr is unmapped
+ * either way.
+ */
+static int mem_pool_put(struct mem_pool *pool, void *ptr)
+{
+    cl_event event;
+    cl_int res;
+
+    if (pool->nfree == MEM_POOL_MAX) {
+        mem_pool_unmap(pool, ptr);
+        return 0;
+    }
+    if (pool->reset == MEM_POOL_DONTNEED) {
+        if (madvise(ptr, pool->size, MADV_DONTNEED)) {
+            mem_pool_unmap(pool, ptr);
+            return 1;
+        }
+    } else if (pool->reset == MEM_POOL_ZERO) {
+        memset(ptr, 0, pool->size);
+    }
+    if (pool->resident) {
+        if (cl_program_migrate_async(pool->resident, ptr, pool->size, 0,
+                                     0, NULL, &event)) {
+            mem_pool_unmap(pool, ptr);
+            return -1;
+        }
+        res = clWaitForEvents(1, &event);
+        clReleaseEvent(event);
+        if (res != CL_SUCCESS) {
+            mem_pool_unmap(pool, ptr);
+            return -1;
+        }
+    }
+    pool->free[pool->nfree++] = ptr;
+    return 0;
+}
+
+static void mem_pool_fini(struct mem_pool *pool)
+{
+    while (pool->nfree) {
+        mem_pool_unmap(pool, pool->free[--pool->nfree]);
+    }
+}
+
+
+struct bench_stats {
+    unsigned n;
+    uint64_t min;
+    uint64_t median;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t max;
+};
+
+static int bench_cmp_u64(const void *pa, const void *pb)
+{
+    uint64_t a = *(const uint64_t *)pa, b = *(const uint64_t *)pb;
+
+    return a < b ? -1 : a > b;
+}
+
+/* Nearest-rank percentile of an already sorted sample array. */
+static uint64_t bench_percentile(const uint64_t *sorted, unsigned n,
+                                 unsigned pct)
+{
+    unsigned rank = (n * pct + 99) / 100;
+
+    return sorted[rank ? rank - 1 : 0];
+}
+
+/* Sorts samples in place. */
+static void bench_stats_compute(uint64_t *samples, unsigned n,
+                                struct bench_stats *stats)
+{
+    qsort(samples, n, sizeof(*samples), bench_cmp_u64);
+    stats->n = n;
+    stats->min = samples[0];
+    stats->median = bench_percentile(samples, n, 50);
+    stats->p90 = bench_percentile(samples, n, 90);
+    stats->p99 = bench_percentile(samples, n, 99);
+    stats->max = samples[n - 1];
+}
+
+/* Device execution time of a command from a profiling enabled queue. */
+static int cl_event_elapsed(cl_event event, uint64_t *ns)
+{
+    cl_ulong start, end;
+    cl_int res;
+
+    res = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START,
+                                  sizeof(start), &start, NULL);
     if (res != CL_SUCCESS) {
         return -1;
     }
+    res = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END,
+                                  sizeof(end), &end, NULL);
+    if (res != CL_SUCCESS) {
+        return -1;
+    }
+    *ns = end - start;
+    return 0;
+}
+
+/* Number of timed repetitions requested through SVM_CL_BENCH, 0 if unset. */
+static unsigned bench_reps(void)
+{
+    const char *env = getenv("SVM_CL_BENCH");
+
+    return env ? strtoul(env, NULL, 0) : 0;
+}
+
+/*
+ * Benchmark mode: when SVM_CL_BENCH=<reps> is set, time that many more runs
+ * of the kernel on the memory the test just validated and print a "BENCH"
+ * line tagged with the backing type. The test already ran once, so this
+ * measures warm runs and not the first GPU fault on the range. The GB/s
+ * figure counts the two words read and the one word written per work item
+ * (one item per page-stride step, not per word) against the median run,
+ * readback included. The kernel and readback medians are reported
+ * separately as well.
+ */
+static int cl_program_bench(struct cl_program *clprog, char *argv[],
+                            const char *backing, void *a, void *b, void *r)
+{
+    struct bench_stats stats, kernel, readback;
+    unsigned i, reps = bench_reps();
+    uint64_t *samples, t;
+    double bytes;
+
+    if (!reps) {
+        return 0;
+    }
+
+    samples = malloc(3 * reps * sizeof(*samples));
+    if (samples == NULL) {
+        return -1;
+    }
+    for (i = 0; i < reps; ++i) {
+        t = time_ns();
+        if (cl_program_run_nocheck(clprog, a, b, r)) {
+            free(samples);
+            return -1;
+        }
+        samples[i] = time_ns() - t;
+        samples[reps + i] = clprog->kernel_ns;
+        samples[2 * reps + i] = clprog->readback_ns;
+    }
+    bench_stats_compute(samples, reps, &stats);
+    bench_stats_compute(samples + reps, reps, &kernel);
+    bench_stats_compute(samples + 2 * reps, reps, &readback);
+    free(samples);
+
+    bytes = 3.0 * cl_program_items(clprog) * sizeof(int);
+    printf("BENCH %s %s nwords %zu reps %u "
+           "min %.3f med %.3f max %.3f ms %.3f GB/s "
+           "kernel %.3f readback %.3f ms pattern %s:%llu\n",
+           basename(argv[0]), backing, clprog->nwords, reps,
+           stats.min / 1e6, stats.median / 1e6, stats.max / 1e6,
+           bytes / stats.median, kernel.median / 1e6,
+           readback.median / 1e6, cl_kernels[clprog->kernel_id].name,
+           (unsigned long long)clprog->kernel_param);
 
     return 0;
 }
 
 
+#ifdef SVM_CL_SUITE
+/* Record the scenario result and reset its program state and mappings. */
+static void cl_suite_end(enum status status)
+{
+    struct cl_suite_map *map;
+    unsigned i;
+
+    cl_suite.status = status;
+    if (cl_suite.current) {
+        cl_program_fini(cl_suite.current);
+        cl_suite.current = NULL;
+    }
+    for (i = 0; i < cl_suite.nmaps; ++i) {
+        map = &cl_suite.maps[i];
+        if (map->ptr == NULL) {
+            continue;
+        }
+        if (map->huge) {
+            free_hugepage_region(map->ptr);
+        } else {
+            munmap(map->ptr, map->size);
+        }
+        map->ptr = NULL;
+    }
+}
+#endif
+
+
 #endif /* SVM_CL_TESTS_HELPERS_H */
@@ -0,0 +1,266 @@
+/*
+ * Copyright 2018 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef SVM_CL_TESTS_NUMA_H
+#define SVM_CL_TESTS_NUMA_H
+
+/*
+ * NUMA placement through the raw mbind() and move_pages() syscalls, so
+ * there is no libnuma dependency. Node masks are one unsigned long, nodes
+ * past 63 are not supported. A placement is written as
+ *
+ *   default | bind:NODES | preferred:NODE | interleave[:NODES]
+ *
+ * where NODES is a list such as "0", "0,2" or "0-3" and interleave without
+ * nodes means all online nodes.
+ */
+#include <dirent.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef MPOL_DEFAULT
+#define MPOL_DEFAULT        0
+#define MPOL_PREFERRED      1
+#define MPOL_BIND           2
+#define MPOL_INTERLEAVE     3
+#endif
+#ifndef MPOL_MF_MOVE
+#define MPOL_MF_MOVE        (1 << 1)
+#endif
+
+#define NUMA_MAX_NODES      (8 * sizeof(unsigned long))
+
+enum numa_policy {
+    NUMA_DEFAULT,
+    NUMA_BIND,
+    NUMA_PREFERRED,
+    NUMA_INTERLEAVE,
+    NUMA_NPOLICIES,
+};
+
+static const char *numa_policy_names[NUMA_NPOLICIES] = {
+    [NUMA_DEFAULT] = "default",
+    [NUMA_BIND] = "bind",
+    [NUMA_PREFERRED] = "preferred",
+    [NUMA_INTERLEAVE] = "interleave",
+};
+
+static const int numa_policy_modes[NUMA_NPOLICIES] = {
+    [NUMA_DEFAULT] = MPOL_DEFAULT,
+    [NUMA_BIND] = MPOL_BIND,
+    [NUMA_PREFERRED] = MPOL_PREFERRED,
+    [NUMA_INTERLEAVE] = MPOL_INTERLEAVE,
+};
+
+struct numa_placement {
+    enum numa_policy policy;
+    unsigned long nodes;
+};
+
+/* Parse a node list such as "0-2,5" into a mask, -1 if malformed. */
+static int numa_parse_nodes(const char *str, unsigned long *nodes)
+{
+    unsigned long first, last;
+    char *end;
+
+    *nodes = 0;
+    do {
+        first = last = strtoul(str, &end, 10);
+        if (end == str) {
+            return -1;
+        }
+        if (*end == '-') {
+            str = end + 1;
+            last = strtoul(str, &end, 10);
+            if (end == str || last < first) {
+                return -1;
+            }
+        }
+        if (last >= NUMA_MAX_NODES) {
+            return -1;
+        }
+        for (; first <= last; ++first) {
+            *nodes |= 1UL << first;
+        }
+        str = end + 1;
+    } while (*end == ',');
+
+    return *end == '\0' || *end == '\n' ? 0 : -1;
+}
+
+/*
+ * Mask of the online nodes, from sysfs. A kernel without NUMA has no
+ * /sys/devices/system/node, that is one node 0.
+ */
+static unsigned long numa_nodes_online(void)
+{
+    static unsigned long online;
+    char line[256];
+    FILE *file;
+
+    if (online) {
+        return online;
+    }
+    file = fopen("/sys/devices/system/node/online", "r");
+    if (file) {
+        if (!fgets(line, sizeof(line), file) ||
+            numa_parse_nodes(line, &online)) {
+            online = 0;
+        }
+        fclose(file);
+    }
+    if (!online) {
+        online = 1;
+    }
+    return online;
+}
+
+static int numa_parse(const char *spec, struct numa_placement *placement)
+{
+    const char *colon = strchr(spec, ':');
+    size_t len = colon ? (size_t)(colon - spec) : strlen(spec);
+    unsigned i;
+
+    for (i = 0; i < NUMA_NPOLICIES; ++i) {
+        if (strlen(numa_policy_names[i]) == len &&
+            !strncmp(spec, numa_policy_names[i], len)) {
+            break;
+        }
+    }
+    if (i == NUMA_NPOLICIES) {
+        return -1;
+    }
+    placement->policy = i;
+    placement->nodes = 0;
+    if (i == NUMA_DEFAULT) {
+        return colon ? -1 : 0;
+    }
+    if (colon == NULL) {
+        if (i != NUMA_INTERLEAVE) {
+            return -1;
+        }
+        placement->nodes = numa_nodes_online();
+        return 0;
+    }
+    if (numa_parse_nodes(colon + 1, &placement->nodes)) {
+        return -1;
+    }
+    /* Preferred takes a single node. */
+    if (i == NUMA_PREFERRED && (placement->nodes & (placement->nodes - 1))) {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Apply the placement to [ptr, ptr + size), ptr page aligned. With
+ * MPOL_MF_MOVE the pages already faulted in are migrated to comply.
+ */
+static int numa_mbind(void *ptr, size_t size,
+                      const struct numa_placement *placement, unsigned flags)
+{
+    if (placement->policy == NUMA_DEFAULT) {
+        return syscall(SYS_mbind, ptr, size, MPOL_DEFAULT, NULL, 0, 0);
+    }
+    return syscall(SYS_mbind, ptr, size, numa_policy_modes[placement->policy],
+                   &placement->nodes, NUMA_MAX_NODES + 1, flags);
+}
+
+/*
+ * Node of the page at ptr, -1 if it is not present in system memory (never
+ * touched, or migrated to the device).
+ */
+static int numa_page_node(void *ptr)
+{
+    int status = -1;
+
+    if (syscall(SYS_move_pages, 0, 1UL, &ptr, NULL, &status, 0)) {
+        return -1;
+    }
+    return status;
+}
+
+/*
+ * Node the GPU hangs off, the first DRM device with a numa_node in sysfs.
+ * That is not matched against the CL device in use, so with several GPUs
+ * on different nodes it may be another GPU's node. -1 when unknown, which
+ * is what single node machines report.
+ */
+static int numa_device_node(void)
+{
+    char path[PATH_MAX];
+    struct dirent *ent;
+    int node = -1;
+    FILE *file;
+    DIR *dir;
+
+    dir = opendir("/sys/class/drm");
+    if (dir == NULL) {
+        return -1;
+    }
+    while (node < 0 && (ent = readdir(dir)) != NULL) {
+        if (strncmp(ent->d_name, "card", 4) &&
+            strncmp(ent->d_name, "renderD", 7)) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "/sys/class/drm/%s/device/numa_node",
+                 ent->d_name);
+        file = fopen(path, "r");
+        if (file) {
+            if (fscanf(file, "%d", &node) != 1) {
+                node = -1;
+            }
+            fclose(file);
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+/*
+ * SLIT distance between two online nodes from sysfs, -1 if unknown. The
+ * distance file has one column per online node, in node order.
+ */
+static int numa_distance(int from, int to)
+{
+    unsigned long online = numa_nodes_online();
+    int i, column, distance = -1;
+    char path[64];
+    FILE *file;
+
+    if (!(online & (1UL << to))) {
+        return -1;
+    }
+    column = __builtin_popcountl(online & ((1UL << to) - 1));
+
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/distance",
+             from);
+    file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    for (i = 0; i <= column; ++i) {
+        if (fscanf(file, "%d", &distance) != 1) {
+            distance = -1;
+            break;
+        }
+    }
+    fclose(file);
+    return distance;
+}
+
+#endif /* SVM_CL_TESTS_NUMA_H */
@@ -0,0 +1,244 @@
+/*
+ * Copyright 2018 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef SVM_CL_TESTS_PAGEMAP_H
+#define SVM_CL_TESTS_PAGEMAP_H
+
+/*
+ * Page residency of a range, from /proc/self/pagemap (see the kernel's
+ * Documentation/admin-guide/mm/pagemap.rst). Each page is classified as:
+ *
+ *   h  present in system memory
+ *   T  present, part of a transparent huge page
+ *   G  present, hugetlbfs page
+ *   Z  present, the shared zero page
+ *   D  not present, special swap entry: device private (migrated to the
+ *      device), device exclusive or under migration
+ *   S  swapped out
+ *   d  D or S, without root the two cannot be told apart
+ *   .  not present, never touched or discarded
+ *
+ * T, G and Z need the PFN and /proc/kpageflags, so root. Otherwise those
+ * pages show as h. Swap entries of a type past the active swap areas in
+ * /proc/swaps are the kernel's special entries, device private included;
+ * the type is only shown to root too, but with no swap area in use any
+ * swap entry is special.
+ *
+ * Present pages mapped by this process alone (bit 56, Linux 4.2) are
+ * counted apart as x, across the classes above. A page still shared after
+ * fork(), with the page cache of another mapping or by KSM is not.
+ */
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PAGEMAP_PRESENT     (1ULL << 63)
+#define PAGEMAP_SWAP        (1ULL << 62)
+#define PAGEMAP_EXCLUSIVE   (1ULL << 56)
+#define PAGEMAP_PFN_MASK    ((1ULL << 55) - 1)
+#define PAGEMAP_SWAP_TYPE   0x1fULL
+
+#define KPF_HUGE            17
+#define KPF_THP             22
+#define KPF_ZERO_PAGE       24
+
+/* Entries read per pread(), and runs printed before eliding the rest. */
+#define PAGEMAP_BATCH       512
+#define PAGEMAP_MAX_RUNS    32
+
+enum pagemap_class {
+    PAGEMAP_HOST,
+    PAGEMAP_THP,
+    PAGEMAP_HUGETLB,
+    PAGEMAP_ZERO,
+    PAGEMAP_DEVICE,
+    PAGEMAP_SWAPPED,
+    PAGEMAP_SWAP_ENTRY,
+    PAGEMAP_NONE,
+    PAGEMAP_NCLASSES,
+};
+
+static const char pagemap_chars[] = "hTGZDSd.";
+
+struct pagemap_counts {
+    size_t n[PAGEMAP_NCLASSES];
+    size_t exclusive;
+};
+
+static unsigned pagemap_swap_areas(void)
+{
+    static int nareas = -1;
+    char line[256];
+    FILE *file;
+
+    if (nareas >= 0) {
+        return nareas;
+    }
+    nareas = 0;
+    file = fopen("/proc/swaps", "r");
+    if (file) {
+        /* Skip the header line. */
+        if (fgets(line, sizeof(line), file)) {
+            while (fgets(line, sizeof(line), file)) {
+                nareas++;
+            }
+        }
+        fclose(file);
+    }
+    return nareas;
+}
+
+static enum pagemap_class pagemap_classify(uint64_t entry, int kpageflags)
+{
+    uint64_t pfn, flags;
+
+    if (entry & PAGEMAP_SWAP) {
+        if (!pagemap_swap_areas()) {
+            return PAGEMAP_DEVICE;
+        }
+        /* Offset 0 is the swap header, all zero means it is hidden. */
+        if (!(entry & PAGEMAP_PFN_MASK)) {
+            return PAGEMAP_SWAP_ENTRY;
+        }
+        return (entry & PAGEMAP_SWAP_TYPE) < pagemap_swap_areas() ?
+               PAGEMAP_SWAPPED : PAGEMAP_DEVICE;
+    }
+    if (!(entry & PAGEMAP_PRESENT)) {
+        return PAGEMAP_NONE;
+    }
+    pfn = entry & PAGEMAP_PFN_MASK;
+    if (kpageflags < 0 || !pfn ||
+        pread(kpageflags, &flags, sizeof(flags),
+              pfn * sizeof(flags)) != sizeof(flags)) {
+        return PAGEMAP_HOST;
+    }
+    if (flags & (1ULL << KPF_ZERO_PAGE)) {
+        return PAGEMAP_ZERO;
+    }
+    if (flags & (1ULL << KPF_HUGE)) {
+        return PAGEMAP_HUGETLB;
+    }
+    if (flags & (1ULL << KPF_THP)) {
+        return PAGEMAP_THP;
+    }
+    return PAGEMAP_HOST;
+}
+
+/*
+ * Classify each page of [ptr, ptr + size), widened to whole pages, calling
+ * run(class, npages, arg) (if not NULL) for each run of same class pages in
+ * address order, and adding up the pages per class in counts (if not NULL).
+ * Returns -1 if /proc/self/pagemap cannot be read.
+ */
+static int pagemap_scan(const void *ptr, size_t size,
+                        void (*run)(enum pagemap_class, size_t, void *),
+                        void *arg, struct pagemap_counts *counts)
+{
+    uint64_t entries[PAGEMAP_BATCH];
+    size_t page = sysconf(_SC_PAGESIZE), i, j, n, runlen = 0;
+    uintptr_t first = (uintptr_t)ptr / page;
+    size_t npages = ((uintptr_t)ptr + size + page - 1) / page - first;
+    enum pagemap_class class, prev = PAGEMAP_NCLASSES;
+    int fd, kpageflags, ret = -1;
+
+    if (counts) {
+        memset(counts, 0, sizeof(*counts));
+    }
+    fd = open("/proc/self/pagemap", O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    kpageflags = open("/proc/kpageflags", O_RDONLY);
+
+    for (i = 0; i < npages; i += n) {
+        n = npages - i < PAGEMAP_BATCH ? npages - i : PAGEMAP_BATCH;
+        if (pread(fd, entries, n * sizeof(uint64_t),
+                  (first + i) * sizeof(uint64_t)) !=
+            (ssize_t)(n * sizeof(uint64_t))) {
+            goto out;
+        }
+        for (j = 0; j < n; ++j) {
+            class = pagemap_classify(entries[j], kpageflags);
+            if (counts) {
+                counts->n[class]++;
+                if ((entries[j] & PAGEMAP_PRESENT) &&
+                    (entries[j] & PAGEMAP_EXCLUSIVE)) {
+                    counts->exclusive++;
+                }
+            }
+            if (class != prev && runlen && run) {
+                run(prev, runlen, arg);
+                runlen = 0;
+            }
+            prev = class;
+            runlen++;
+        }
+    }
+    if (runlen && run) {
+        run(prev, runlen, arg);
+    }
+    ret = 0;
+out:
+    if (kpageflags >= 0) {
+        close(kpageflags);
+    }
+    close(fd);
+    return ret;
+}
+
+struct pagemap_rle {
+    FILE *file;
+    unsigned nruns;
+};
+
+static void pagemap_rle_run(enum pagemap_class class, size_t npages,
+                            void *arg)
+{
+    struct pagemap_rle *rle = arg;
+
+    if (rle->nruns++ < PAGEMAP_MAX_RUNS) {
+        fprintf(rle->file, " %zu%c", npages, pagemap_chars[class]);
+    } else if (rle->nruns == PAGEMAP_MAX_RUNS + 1) {
+        fprintf(rle->file, " ...");
+    }
+}
+
+/*
+ * Print one line for the range: label, address, the run-length map
+ * ("512T 16D 496."), the page count per class and the exclusive count.
+ */
+static int pagemap_dump(FILE *file, const char *label, const void *ptr,
+                        size_t size)
+{
+    struct pagemap_rle rle = { file, 0 };
+    struct pagemap_counts counts;
+    unsigned i;
+
+    fprintf(file, "PAGEMAP %-24s %p:", label, ptr);
+    if (pagemap_scan(ptr, size, pagemap_rle_run, &rle, &counts)) {
+        fprintf(file, " unreadable\n");
+        return -1;
+    }
+    fprintf(file, " |");
+    for (i = 0; i < PAGEMAP_NCLASSES; ++i) {
+        if (counts.n[i]) {
+            fprintf(file, " %c=%zu", pagemap_chars[i], counts.n[i]);
+        }
+    }
+    fprintf(file, " x=%zu\n", counts.exclusive);
+    return 0;
+}
+
+#endif /* SVM_CL_TESTS_PAGEMAP_H */
@@ -1,11 +1,38 @@
 #!/bin/sh
+# Run every test, up to -j jobs (default: number of CPUs) at a time.
+# Tests that use a global resource are serialized on a lock for it, see
+# run-test.sh. Prints each test's output as it finishes, then the exit
+# status and wall time of every test.
 base=`dirname $0`
 cd $base
 PATH=$PATH:./
-tests=`find . -maxdepth 1 -type f -executable  | grep -v .sh`
-for i in $tests ; do
-    echo Running $i
-    $base/run.sh `basename $i`
-    sync
-    sleep 5
+jobs=`nproc`
+while getopts j: opt ; do
+    case $opt in
+    j) jobs=$OPTARG ;;
+    *) echo "usage: $0 [-j jobs]" >&2 ; exit 2 ;;
+    esac
 done
+
+results=`mktemp -d`
+trap 'rm -rf $results' EXIT
+sudo sync
+export SVM_CL_NOSYNC=1
+
+start=`date +%s%N`
+find . -maxdepth 1 -type f -executable -name 'test-*' | sed 's#^\./##' |
+    sort | xargs -P $jobs -I{} ./run-test.sh $results {}
+wall=$(( (`date +%s%N` - start) / 1000000 ))
+
+echo
+failed=0
+total=0
+for i in $results/*.result ; do
+    read status ms < $i
+    name=`basename $i .result`
+    printf "%-4s %-28s %8d ms\n" $status $name $ms
+    total=$((total + ms))
+    [ $status = OK ] || failed=$((failed + 1))
+done
+echo "$failed failed, wall $wall ms, sum of tests $total ms, $jobs jobs"
+[ $failed = 0 ]
@@ -0,0 +1,36 @@
+#!/bin/sh
+# Run one test for run-all.sh: run-test.sh <results dir> <test>
+#
+# Tests contending for a global resource hold a lock for it while they run:
+# hugetlbfs for the hugetlbfs pool, thp for THP/khugepaged and vram for
+# device memory (the *vram* and *migrate* tests migrate into it). Locks nest
+# in the same order for every test. The exit status, wall time and output
+# end up in <results dir>/<test>.{result,log}.
+dir=$1
+test=$2
+lockdir=${TMPDIR:-/tmp}
+
+locks=
+case $test in *hugetlb*) locks="$locks hugetlbfs" ;; esac
+case $test in *thp*|*tmpfs-huge*) locks="$locks thp" ;; esac
+case $test in *vram*|*migrate*) locks="$locks vram" ;; esac
+
+cmd="./run.sh ./$test"
+for i in $locks ; do
+    cmd="flock $lockdir/svm-cl-tests.$i.lock $cmd"
+done
+
+start=`date +%s%N`
+$cmd > $dir/$test.log 2>&1
+status=$?
+ms=$(( (`date +%s%N` - start) / 1000000 ))
+
+# Tests report failures through print_status() and still exit 0.
+if [ $status != 0 ] || grep -q '31mEE' $dir/$test.log ; then
+    result=FAIL
+else
+    result=OK
+fi
+echo "$result $ms" > $dir/$test.result
+cat $dir/$test.log
+echo
@@ -0,0 +1,137 @@
+/*
+ * Copyright 2018 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+/*
+ * Run every test in one process. The OpenCL context, queue and program are
+ * created once and shared, each test-*.c is linked in with its main()
+ * renamed to <name>_main (see the Makefile) and runs as one scenario.
+ *
+ * Usage: svm-cl-suite [test-name ...]
+ */
+#include "helpers.h"
+
+#define SCENARIOS(X) \
+    X(test_malloc_read) \
+    X(test_malloc_write) \
+    X(test_malloc_vram_read) \
+    X(test_malloc_vram_clear) \
+    X(test_malloc_vram_write) \
+    X(test_malloc_vram_plus) \
+    X(test_share_read) \
+    X(test_share_write) \
+    X(test_hugetlbfs_read) \
+    X(test_hugetlbfs_write) \
+    X(test_file_read) \
+    X(test_file_write) \
+    X(test_file_private) \
+    X(test_write_hole) \
+    X(test_data_read) \
+    X(test_data_write) \
+    X(test_stack_read) \
+    X(test_stack_write) \
+    X(test_thp_read) \
+    X(test_thp_write) \
+    X(test_malloc_read_zero) \
+    X(test_thp_migrate) \
+    X(test_thp_zero) \
+    X(test_memfd_read) \
+    X(test_memfd_write) \
+    X(test_memfd_migrate) \
+    X(test_memfd_hugetlb_read) \
+    X(test_memfd_hugetlb_write) \
+    X(test_memfd_hugetlb_migrate) \
+    X(test_tmpfs_huge_read) \
+    X(test_tmpfs_huge_write) \
+    X(test_tmpfs_huge_migrate) \
+    X(test_malloc_migrate_ranges) \
+    X(test_malloc_vram_discard)
+
+#define SCENARIO_DECLARE(name) int name##_main(int argc, char *argv[]);
+#define SCENARIO_ENTRY(name) { #name, name##_main },
+
+SCENARIOS(SCENARIO_DECLARE)
+
+struct scenario {
+    const char *name;
+    int (*main)(int argc, char *argv[]);
+};
+
+static const struct scenario scenarios[] = {
+    SCENARIOS(SCENARIO_ENTRY)
+};
+
+struct cl_suite cl_suite;
+
+/* Scenario names use the executable spelling, test-malloc-read. */
+static int scenario_selected(const char *name, int argc, char *argv[])
+{
+    int i;
+
+    if (argc < 2) {
+        return 1;
+    }
+    for (i = 1; i < argc; ++i) {
+        if (!strcmp(name, basename(argv[i]))) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned i, nrun = 0, nfail = 0;
+    struct cl_program base;
+    uint64_t start, t;
+    char name[64], *p;
+    char *targv[2];
+
+    start = time_ns();
+    if (cl_context_init(&base)) {
+        fprintf(stderr, "%s: cl context init failed\n", argv[0]);
+        return 1;
+    }
+    cl_suite.base = &base;
+    printf("cl context init %.3f ms\n", (time_ns() - start) / 1e6);
+
+    for (i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); ++i) {
+        snprintf(name, sizeof(name), "%s", scenarios[i].name);
+        for (p = name; *p; ++p) {
+            if (*p == '_') {
+                *p = '-';
+            }
+        }
+        if (!scenario_selected(name, argc, argv)) {
+            continue;
+        }
+
+        targv[0] = name;
+        targv[1] = NULL;
+        cl_suite.current = NULL;
+        cl_suite.status = ERROR;
+        t = time_ns();
+        scenarios[i].main(1, targv);
+        printf("\t%.3f ms\n", (time_ns() - t) / 1e6);
+        nrun++;
+        if (cl_suite.status == ERROR) {
+            nfail++;
+        }
+    }
+
+    cl_context_fini(&base);
+
+    printf("%u scenarios, %u failed, %.3f s\n", nrun, nfail,
+           (time_ns() - start) / 1e9);
+    return nfail ? 1 : 0;
+}
@@ -17,23 +17,29 @@
 
 #define NWORDS  (1 << 16)
 
-int data[NWORDS];
+static int data[NWORDS];
 
 int main(int argc, char* argv[])
 {
     enum status status = SUCCESS;
     struct cl_program clprog;
+    size_t nwords = parse_nwords(argc, argv, NWORDS);
     char *append = "\n";
     int res;
 
-    res = cl_program_init(&clprog, NWORDS);
+    /* The array has a fixed size, larger requests are clamped to it. */
+    if (nwords > NWORDS) {
+        nwords = NWORDS;
+    }
+
+    res = cl_program_init(&clprog, nwords);
     if (res) {
         append = "cl program init failed\n";
         status = ERROR;
         goto out;
     }
 
-    memcpy(data, clprog.a, NWORDS * sizeof(int));
+    cl_program_fill(&clprog, data, CL_ARG_A);
 
     res = cl_program_run(&clprog, data, NULL, NULL);
     if (res) {
@@ -42,6 +48,13 @@ int main(int argc, char* argv[])
         goto out;
     }
 
+    res = cl_program_bench(&clprog, argv, "data", data, NULL, NULL);
+    if (res) {
+        append = "cl program bench failed\n";
+        status = ERROR;
+        goto out;
+    }
+
 out:
     print_status(status, argv, append);
     return 0;
@@ -21,11 +21,10 @@ int main(int argc, char* argv[])
 {
     enum status status = SUCCESS;
     struct cl_program clprog;
+    size_t nwords = parse_nwords(argc, argv, NWORDS);
     char *append = "\n";
     int res, fd;
-    unsigned i;
     void *map;
-    ssize_t len;
 
     /* Create file and initialize its content. */
     fd = open("/tmp/." __FILE__, O_CREAT | O_TRUNC | O_RDWR, S_IRWXU);
@@ -34,23 +33,31 @@ int main(int argc, char* argv[])
         status = ERROR;
         goto out;
     }
-    for (i = 0; i < NWORDS; ++i) {
-        write(fd, &i, sizeof(int));
+    if (file_write_linear(fd, nwords, 0, 1)) {
+        append = "writing file failed\n";
+        status = ERROR;
+        goto out;
     }
     fsync(fd);
-    map = mem_file_map_share(fd, NWORDS * sizeof(int));
+    map = mem_file_map_share(fd, nwords * sizeof(int));
     if (map == NULL) {
         append = "mapping file failed\n";
         status = ERROR;
         goto out;
     }
 
-    res = cl_program_init(&clprog, NWORDS);
+    res = cl_program_init(&clprog, nwords);
     if (res) {
         append = "cl program init failed\n";
         status = ERROR;
         goto out;
     }
+    res = cl_program_select_full(&clprog);
+    if (res) {
+        append = "cl program select failed\n";
+        status = ERROR;
+        goto out;
+    }
 
     res = cl_program_run(&clprog, map, NULL, map);
     if (res) {
@@ -59,8 +66,16 @@ int main(int argc, char* argv[])
         goto out;
     }
 
+    /* Writing again would change what lands in the file, only time reads. */
+    res = cl_program_bench(&clprog, argv, "file-share", map, NULL, NULL);
+    if (res) {
+        append = "cl program bench failed\n";
+        status = ERROR;
+        goto out;
+    }
+
     /* Close file, and re-open it and check its content. */
-    mem_unmap(map, NWORDS * sizeof(int));
+    mem_unmap(map, nwords * sizeof(int));
     close(fd);
     fd = open("/tmp/." __FILE__, O_RDWR);
     if (fd < 0) {
@@ -68,15 +83,10 @@ int main(int argc, char* argv[])
         status = ERROR;
         goto out;
     }
-    for (i = 0; i < NWORDS; ++i) {
-        unsigned v;
-
-        len = read(fd, &v, sizeof(int));
-        if (len != sizeof(v) || v) {
-            append = "checking file failed\n";
-            status = ERROR;
-            goto out;
-        }
+    if (file_verify_linear(fd, nwords, 0, 0)) {
+        append = "checking file failed\n";
+        status = ERROR;
+        goto out;
     }
 
 out:
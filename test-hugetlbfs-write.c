@@ -21,25 +21,26 @@ int main(int argc, char* argv[])
 {
     enum status status = SUCCESS;
     struct cl_program clprog;
+    size_t nwords = parse_nwords(argc, argv, NWORDS);
     char *append = "\n";
     void *map;
     int res;
 
-    map = hugefs_alloc(NWORDS * sizeof(int));
+    map = hugefs_alloc(nwords * sizeof(int));
     if (map == NULL) {
         append = "mapping anon failed\n";
         status = ERROR;
         goto out;
     }
 
-    res = cl_program_init(&clprog, NWORDS);
+    res = cl_program_init(&clprog, nwords);
     if (res) {
         append = "cl program init failed\n";
         status = ERROR;
         goto out;
     }
 
-    memcpy(map, clprog.r, NWORDS * sizeof(int));
+    cl_program_fill(&clprog, map, CL_ARG_R);
 
     res = cl_program_run(&clprog, NULL, NULL, map);
     if (res) {
@@ -48,6 +49,13 @@ int main(int argc, char* argv[])
         goto out;
     }
 
+    res = cl_program_bench(&clprog, argv, "hugetlbfs", NULL, NULL, map);
+    if (res) {
+        append = "cl program bench failed\n";
+        status = ERROR;
+        goto out;
+    }
+
     hugefs_free(map);
 
 out:
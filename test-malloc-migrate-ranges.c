@@ -0,0 +1,101 @@
+/*
+ * Copyright 2018 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#include "helpers.h"
+
+#define NWORDS  (1 << 16)
+
+int main(int argc, char* argv[])
+{
+    enum status status = SUCCESS;
+    struct cl_program clprog;
+    size_t nwords = parse_nwords(argc, argv, NWORDS);
+    size_t size = nwords * sizeof(int);
+    struct pagemap_counts counts;
+    struct cl_range ranges[7];
+    char *append = "\n";
+    char *map;
+    int res;
+
+    map = mem_anon_map(size);
+    if (map == NULL) {
+        append = "mapping anon failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    res = cl_program_init(&clprog, nwords);
+    if (res) {
+        append = "cl program init failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    cl_program_fill(&clprog, map, CL_ARG_A);
+
+    /*
+     * Unaligned, unsorted, overlapping, adjacent after page rounding, empty
+     * and duplicate ranges that together cover the whole mapping.
+     */
+    ranges[0] = (struct cl_range){ map + 1, size / 2 };
+    ranges[1] = (struct cl_range){ map, 1 };
+    ranges[2] = (struct cl_range){ map + size / 2 + 100, size / 4 };
+    ranges[3] = (struct cl_range){ map + size / 2, 0 };
+    ranges[4] = (struct cl_range){ map + size / 4 * 3, size - size / 4 * 3 };
+    ranges[5] = (struct cl_range){ map + size / 2 - 8, 16 };
+    ranges[6] = ranges[2];
+    res = cl_program_migrate_ranges(&clprog, ranges, 7);
+    if (res) {
+        append = "migrating ranges failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    /*
+     * The merged ranges cover the mapping, so no page may be left in system
+     * memory. Skipped when /proc/self/pagemap cannot be read.
+     */
+    if (!pagemap_scan(map, size, NULL, NULL, &counts) &&
+        counts.n[PAGEMAP_HOST] + counts.n[PAGEMAP_THP] +
+        counts.n[PAGEMAP_ZERO]) {
+        append = "pages left in system memory\n";
+        status = ERROR;
+        goto out;
+    }
+
+    res = cl_program_run(&clprog, map, NULL, NULL);
+    if (res) {
+        append = "cl program run failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    if (verify_linear(map, nwords, 0, 1, NULL)) {
+        append = "post compare failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    res = cl_program_bench(&clprog, argv, "anon", map, NULL, NULL);
+    if (res) {
+        append = "cl program bench failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    mem_unmap(map, size);
+
+out:
+    print_status(status, argv, append);
+    return 0;
+}
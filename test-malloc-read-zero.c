@@ -21,26 +21,33 @@ int main(int argc, char* argv[])
 {
     enum status status = SUCCESS;
     struct cl_program clprog;
+    size_t nwords = parse_nwords(argc, argv, NWORDS);
     char *append = "\n";
     void *map;
     int res;
-    unsigned i;
+    size_t i;
 
-    map = mem_anon_map(NWORDS * sizeof(int));
+    map = mem_anon_map(nwords * sizeof(int));
     if (map == NULL) {
         append = "mapping anon failed\n";
         status = ERROR;
         goto out;
     }
 
-    res = cl_program_init(&clprog, NWORDS);
+    res = cl_program_init(&clprog, nwords);
     if (res) {
         append = "cl program init failed\n";
         status = ERROR;
         goto out;
     }
+    res = cl_program_select_full(&clprog);
+    if (res) {
+        append = "cl program select failed\n";
+        status = ERROR;
+        goto out;
+    }
 
-    if (mprotect(map, NWORDS * sizeof(int), PROT_READ)) {
+    if (mprotect(map, nwords * sizeof(int), PROT_READ)) {
         append = "mprotect failed\n";
         status = ERROR;
         goto out;
@@ -59,16 +66,21 @@ int main(int argc, char* argv[])
         status = ERROR;
         goto out;
     }
-    for (i = 0; i < NWORDS; ++i) {
-        if (clprog.r[i] != -i) {
-            printf("r[%d] = %d\n", i, clprog.r[i]); // XXX
-            append = "cl program check failed\n";
-            status = ERROR;
-            goto out;
-        }
+    if (verify_linear(clprog.out, nwords, 0, -1, &i)) {
+        printf("r[%zu] = %d\n", i, clprog.out[i]); // XXX
+        append = "cl program check failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    res = cl_program_bench(&clprog, argv, "anon-zero", map, NULL, NULL);
+    if (res) {
+        append = "cl program bench failed\n";
+        status = ERROR;
+        goto out;
     }
 
-    mem_unmap(map, NWORDS * sizeof(int));
+    mem_unmap(map, nwords * sizeof(int));
 
 out:
     print_status(status, argv, append);
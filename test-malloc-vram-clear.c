@@ -24,11 +24,9 @@ int main(int argc, char* argv[])
     char *append = "\n";
     void *map;
     int res;
-    unsigned nwords = NWORDS;
-    unsigned i;
+    size_t nwords = parse_nwords(argc, argv, NWORDS);
+    size_t i;
 
-    if (argc > 1)
-        nwords = strtol(argv[1], NULL, 0);
 
     map = mem_anon_map(nwords * sizeof(int));
     if (map == NULL) {
@@ -43,6 +41,12 @@ int main(int argc, char* argv[])
         status = ERROR;
         goto out;
     }
+    res = cl_program_select_full(&clprog);
+    if (res) {
+        append = "cl program select failed\n";
+        status = ERROR;
+        goto out;
+    }
 
     if (mprotect(map, nwords * sizeof(int), PROT_READ)) {
         append = "mprotect failed\n";
@@ -62,13 +66,18 @@ int main(int argc, char* argv[])
         status = ERROR;
         goto out;
     }
-    for (i = 0; i < nwords; ++i) {
-        if (clprog.r[i] != -i) {
-            printf("i %u map %d r %d\n", i, ((int *)map)[i], clprog.r[i]); // XXX
-            append = "data compare failed\n";
-            status = ERROR;
-            goto out;
-        }
+    if (verify_linear(clprog.out, nwords, 0, -1, &i)) {
+        printf("i %zu map %d r %d\n", i, ((int *)map)[i], clprog.out[i]); // XXX
+        append = "data compare failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    res = cl_program_bench(&clprog, argv, "anon-vram", map, NULL, NULL);
+    if (res) {
+        append = "cl program bench failed\n";
+        status = ERROR;
+        goto out;
     }
 
     mem_unmap(map, nwords * sizeof(int));
@@ -0,0 +1,70 @@
+/*
+ * Copyright 2018 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#include "helpers.h"
+
+#define NWORDS  (1 << 16)
+
+int main(int argc, char* argv[])
+{
+    enum status status = SUCCESS;
+    struct cl_program clprog;
+    char *append = "\n";
+    void *map;
+    int res;
+    size_t nwords = parse_nwords(argc, argv, NWORDS);
+
+    map = mem_anon_map(nwords * sizeof(int));
+    if (map == NULL) {
+        append = "mapping anon failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    res = cl_program_init(&clprog, nwords);
+    if (res) {
+        append = "cl program init failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    cl_program_fill(&clprog, map, CL_ARG_R);
+
+    res = cl_program_migrate_discard(&clprog, map);
+    if (res) {
+        append = "migrating memory failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    res = cl_program_run(&clprog, NULL, NULL, map);
+    if (res) {
+        append = "cl program run failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    /* The readback above brought r back, the reps write host memory. */
+    res = cl_program_bench(&clprog, argv, "anon-host-warm", NULL, NULL, map);
+    if (res) {
+        append = "cl program bench failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    mem_unmap(map, nwords * sizeof(int));
+
+out:
+    print_status(status, argv, append);
+    return 0;
+}
@@ -24,10 +24,7 @@ int main(int argc, char* argv[])
     char *append = "\n";
     void *map;
     int res;
-    unsigned nwords = NWORDS;
-
-    if (argc > 1)
-	    nwords = strtol(argv[1], NULL, 0);
+    size_t nwords = parse_nwords(argc, argv, NWORDS);
 
     map = mem_anon_map(nwords * sizeof(int));
     if (map == NULL) {
@@ -43,7 +40,7 @@ int main(int argc, char* argv[])
         goto out;
     }
 
-    memcpy(map, clprog.r, nwords * sizeof(int));
+    cl_program_fill(&clprog, map, CL_ARG_R);
 
     res = cl_program_migrate(&clprog, map);
     if (res) {
@@ -59,6 +56,14 @@ int main(int argc, char* argv[])
         goto out;
     }
 
+    /* The readback above brought r back, the reps write host memory. */
+    res = cl_program_bench(&clprog, argv, "anon-host-warm", NULL, NULL, map);
+    if (res) {
+        append = "cl program bench failed\n";
+        status = ERROR;
+        goto out;
+    }
+
     mem_unmap(map, nwords * sizeof(int));
 
 out:
@@ -0,0 +1,67 @@
+/*
+ * Copyright 2018 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#include "helpers.h"
+
+#define NWORDS  (1 << 20)
+
+int main(int argc, char* argv[])
+{
+    enum status status = SUCCESS;
+    struct cl_program clprog;
+    size_t nwords = parse_nwords(argc, argv, NWORDS);
+    char *append = "\n";
+    void *map;
+    int res;
+
+    map = mem_memfd_hugetlb_map(nwords * sizeof(int));
+    if (map == NULL) {
+        append = "mapping memfd hugetlb failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    res = cl_program_init(&clprog, nwords);
+    if (res) {
+        append = "cl program init failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    cl_program_fill(&clprog, map, CL_ARG_A);
+    if (mprotect(map, nwords * sizeof(int), PROT_READ)) {
+        append = "mprotect failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    res = cl_program_run(&clprog, map, NULL, NULL);
+    if (res) {
+        append = "cl program run failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    res = cl_program_bench(&clprog, argv, "memfd-hugetlb", map, NULL, NULL);
+    if (res) {
+        append = "cl program bench failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    mem_memfd_hugetlb_unmap(map, nwords * sizeof(int));
+
+out:
+    print_status(status, argv, append);
+    return 0;
+}
@@ -21,26 +21,27 @@ int main(int argc, char* argv[])
 {
     enum status status = SUCCESS;
     struct cl_program clprog;
+    size_t nwords = parse_nwords(argc, argv, NWORDS);
     char *append = "\n";
     void *map;
     int res;
 
-    map = mem_share_map(NWORDS * sizeof(int));
+    map = mem_share_map(nwords * sizeof(int));
     if (map == NULL) {
         append = "mapping anon failed\n";
         status = ERROR;
         goto out;
     }
 
-    res = cl_program_init(&clprog, NWORDS);
+    res = cl_program_init(&clprog, nwords);
     if (res) {
         append = "cl program init failed\n";
         status = ERROR;
         goto out;
     }
 
-    memcpy(map, clprog.a, NWORDS * sizeof(int));
-    if (mprotect(map, NWORDS * sizeof(int), PROT_READ)) {
+    cl_program_fill(&clprog, map, CL_ARG_A);
+    if (mprotect(map, nwords * sizeof(int), PROT_READ)) {
         append = "mprotect failed\n";
         status = ERROR;
         goto out;
@@ -53,7 +54,14 @@ int main(int argc, char* argv[])
         goto out;
     }
 
-    mem_unmap(map, NWORDS * sizeof(int));
+    res = cl_program_bench(&clprog, argv, "share", map, NULL, NULL);
+    if (res) {
+        append = "cl program bench failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    mem_unmap(map, nwords * sizeof(int));
 
 out:
     print_status(status, argv, append);
@@ -21,25 +21,26 @@ int main(int argc, char* argv[])
 {
     enum status status = SUCCESS;
     struct cl_program clprog;
+    size_t nwords = parse_nwords(argc, argv, NWORDS);
     char *append = "\n";
     void *map;
     int res;
 
-    map = mem_share_map(NWORDS * sizeof(int));
+    map = mem_share_map(nwords * sizeof(int));
     if (map == NULL) {
         append = "mapping anon failed\n";
         status = ERROR;
         goto out;
     }
 
-    res = cl_program_init(&clprog, NWORDS);
+    res = cl_program_init(&clprog, nwords);
     if (res) {
         append = "cl program init failed\n";
         status = ERROR;
         goto out;
     }
 
-    memcpy(map, clprog.r, NWORDS * sizeof(int));
+    cl_program_fill(&clprog, map, CL_ARG_R);
 
     res = cl_program_run(&clprog, NULL, NULL, map);
     if (res) {
@@ -48,7 +49,14 @@ int main(int argc, char* argv[])
         goto out;
     }
 
-    mem_unmap(map, NWORDS * sizeof(int));
+    res = cl_program_bench(&clprog, argv, "share", NULL, NULL, map);
+    if (res) {
+        append = "cl program bench failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    mem_unmap(map, nwords * sizeof(int));
 
 out:
     print_status(status, argv, append);
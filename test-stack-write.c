@@ -21,18 +21,24 @@ int main(int argc, char* argv[])
 {
     enum status status = SUCCESS;
     struct cl_program clprog;
+    size_t nwords = parse_nwords(argc, argv, NWORDS);
     char *append = "\n";
     int res;
     int data[NWORDS];
 
-    res = cl_program_init(&clprog, NWORDS);
+    /* The array has a fixed size, larger requests are clamped to it. */
+    if (nwords > NWORDS) {
+        nwords = NWORDS;
+    }
+
+    res = cl_program_init(&clprog, nwords);
     if (res) {
         append = "cl program init failed\n";
         status = ERROR;
         goto out;
     }
 
-    memcpy(data, clprog.r, NWORDS * sizeof(int));
+    cl_program_fill(&clprog, data, CL_ARG_R);
 
     res = cl_program_run(&clprog, NULL, NULL, data);
     if (res) {
@@ -41,6 +47,13 @@ int main(int argc, char* argv[])
         goto out;
     }
 
+    res = cl_program_bench(&clprog, argv, "stack", NULL, NULL, data);
+    if (res) {
+        append = "cl program bench failed\n";
+        status = ERROR;
+        goto out;
+    }
+
 out:
     print_status(status, argv, append);
     return 0;
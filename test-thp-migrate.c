@@ -22,6 +22,8 @@ int main(int argc, char* argv[])
 {
     enum status status = SUCCESS;
     struct cl_program clprog;
+    size_t nwords = parse_nwords(argc, argv, NWORDS);
+    size_t length = ALIGN(nwords * sizeof(int), TWOMEG);
     char *append = "\n";
     void *map_orig;
     void *map;
@@ -31,29 +33,24 @@ int main(int argc, char* argv[])
     size_t size;
     cl_int cl_res;
 
-    map_orig = mem_anon_map(2 * TWOMEG);
+    map_orig = mem_anon_map_advise(length + TWOMEG, MADV_HUGEPAGE);
     if (map_orig == NULL) {
         append = "mapping anon failed\n";
         status = ERROR;
         goto out;
     }
     map = (void *)ALIGN((uintptr_t)map_orig, TWOMEG);
-    if (madvise(map, TWOMEG, MADV_HUGEPAGE)) {
-        append = "madvise huge failed\n";
-        status = ERROR;
-        goto out;
-    }
 
-    res = cl_program_init(&clprog, NWORDS);
+    res = cl_program_init(&clprog, nwords);
     if (res) {
         append = "cl program init failed\n";
         status = ERROR;
         goto out;
     }
 
-    memcpy(map, clprog.a, NWORDS * sizeof(int));
+    cl_program_fill(&clprog, map, CL_ARG_A);
 #if 0
-    if (mprotect(map, NWORDS * sizeof(int), PROT_READ)) {
+    if (mprotect(map, nwords * sizeof(int), PROT_READ)) {
         append = "mprotect failed\n";
         status = ERROR;
         goto out;
@@ -61,7 +58,7 @@ int main(int argc, char* argv[])
 #endif
 
     ptrs[0] = map;
-    size = TWOMEG;
+    size = length;
     cl_res = clEnqueueSVMMigrateMem(clprog.queue, 1, ptrs, &size,
 		    0, 0, NULL, &event);
     if (cl_res != CL_SUCCESS) {
@@ -83,13 +80,58 @@ int main(int argc, char* argv[])
         goto out;
     }
 
-    if (memcmp(map, clprog.a, NWORDS * sizeof(int))) {
+    if (verify_linear(map, nwords, 0, 1, NULL)) {
         append = "post compare failed\n";
         status = ERROR;
         goto out;
     }
 
-    mem_unmap(map_orig, 2 * TWOMEG);
+    /*
+     * To the device again and back explicitly, before the host touches it
+     * so the migration has something to move, then once more to the device.
+     */
+    res = cl_program_migrate(&clprog, map);
+    if (res) {
+        append = "migrating memory 2nd time failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    res = cl_program_migrate_host(&clprog, map);
+    if (res) {
+        append = "migrating memory to host failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    if (verify_linear(map, nwords, 0, 1, NULL)) {
+        append = "compare after migrating to host failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    res = cl_program_migrate(&clprog, map);
+    if (res) {
+        append = "migrating memory 3rd time failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    res = cl_program_run(&clprog, map, NULL, NULL);
+    if (res) {
+        append = "cl program run 2nd time failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    res = cl_program_bench(&clprog, argv, "thp", map, NULL, NULL);
+    if (res) {
+        append = "cl program bench failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    mem_unmap(map_orig, length + TWOMEG);
 
 out:
     print_status(status, argv, append);
@@ -22,34 +22,31 @@ int main(int argc, char* argv[])
 {
     enum status status = SUCCESS;
     struct cl_program clprog;
+    size_t nwords = parse_nwords(argc, argv, NWORDS);
+    size_t length = ALIGN(nwords * sizeof(int), TWOMEG);
     char *append = "\n";
     void *map_orig;
     void *map;
     int res;
 
-    map_orig = mem_anon_map(2 * TWOMEG);
+    map_orig = mem_anon_map_advise(length + TWOMEG, MADV_HUGEPAGE);
     if (map_orig == NULL) {
         append = "mapping anon failed\n";
         status = ERROR;
         goto out;
     }
     map = (void *)ALIGN((uintptr_t)map_orig, TWOMEG);
-    if (madvise(map, TWOMEG, MADV_HUGEPAGE)) {
-        append = "madvise huge failed\n";
-        status = ERROR;
-        goto out;
-    }
 
-    res = cl_program_init(&clprog, NWORDS);
+    res = cl_program_init(&clprog, nwords);
     if (res) {
         append = "cl program init failed\n";
         status = ERROR;
         goto out;
     }
 
-    memcpy(map, clprog.a, NWORDS * sizeof(int));
+    cl_program_fill(&clprog, map, CL_ARG_A);
 #if 0
-    if (mprotect(map, NWORDS * sizeof(int), PROT_READ)) {
+    if (mprotect(map, nwords * sizeof(int), PROT_READ)) {
         append = "mprotect failed\n";
         status = ERROR;
         goto out;
@@ -63,7 +60,14 @@ int main(int argc, char* argv[])
         goto out;
     }
 
-    mem_unmap(map_orig, 2 * TWOMEG);
+    res = cl_program_bench(&clprog, argv, "thp", map, NULL, NULL);
+    if (res) {
+        append = "cl program bench failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    mem_unmap(map_orig, length + TWOMEG);
 
 out:
     print_status(status, argv, append);
@@ -22,32 +22,29 @@ int main(int argc, char* argv[])
 {
     enum status status = SUCCESS;
     struct cl_program clprog;
+    size_t nwords = parse_nwords(argc, argv, NWORDS);
+    size_t length = ALIGN(nwords * sizeof(int), TWOMEG);
     char *append = "\n";
     void *map_orig;
     void *map;
     int res;
 
-    map_orig = mem_anon_map(2 * TWOMEG);
+    map_orig = mem_anon_map_advise(length + TWOMEG, MADV_HUGEPAGE);
     if (map_orig == NULL) {
         append = "mapping anon failed\n";
         status = ERROR;
         goto out;
     }
     map = (void *)ALIGN((uintptr_t)map_orig, TWOMEG);
-    if (madvise(map, TWOMEG, MADV_HUGEPAGE)) {
-        append = "madvise huge failed\n";
-        status = ERROR;
-        goto out;
-    }
 
-    res = cl_program_init(&clprog, NWORDS);
+    res = cl_program_init(&clprog, nwords);
     if (res) {
         append = "cl program init failed\n";
         status = ERROR;
         goto out;
     }
 
-    memcpy(map, clprog.r, NWORDS * sizeof(int));
+    cl_program_fill(&clprog, map, CL_ARG_R);
 
     res = cl_program_run(&clprog, NULL, NULL, map);
     if (res) {
@@ -56,7 +53,14 @@ int main(int argc, char* argv[])
         goto out;
     }
 
-    mem_unmap(map_orig, 2 * TWOMEG);
+    res = cl_program_bench(&clprog, argv, "thp", NULL, NULL, map);
+    if (res) {
+        append = "cl program bench failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    mem_unmap(map_orig, length + TWOMEG);
 
 out:
     print_status(status, argv, append);
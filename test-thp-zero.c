@@ -22,6 +22,8 @@ int main(int argc, char* argv[])
 {
     enum status status = SUCCESS;
     struct cl_program clprog;
+    size_t nwords = parse_nwords(argc, argv, NWORDS);
+    size_t length = ALIGN(nwords * sizeof(int), TWOMEG);
     char *append = "\n";
     void *map_orig;
     void *map;
@@ -30,36 +32,37 @@ int main(int argc, char* argv[])
     cl_event event;
     size_t size;
     cl_int cl_res;
-    unsigned i;
+    size_t i;
 
-    map_orig = mem_anon_map(2 * TWOMEG);
+    map_orig = mem_anon_map_advise(length + TWOMEG, MADV_HUGEPAGE);
     if (map_orig == NULL) {
         append = "mapping anon failed\n";
         status = ERROR;
         goto out;
     }
     map = (void *)ALIGN((uintptr_t)map_orig, TWOMEG);
-    if (madvise(map, TWOMEG, MADV_HUGEPAGE)) {
-        append = "madvise huge failed\n";
+
+    res = cl_program_init(&clprog, nwords);
+    if (res) {
+        append = "cl program init failed\n";
         status = ERROR;
         goto out;
     }
-
-    res = cl_program_init(&clprog, NWORDS);
+    res = cl_program_select_full(&clprog);
     if (res) {
-        append = "cl program init failed\n";
+        append = "cl program select failed\n";
         status = ERROR;
         goto out;
     }
 
-    if (mprotect(map, NWORDS * sizeof(int), PROT_READ)) {
+    if (mprotect(map, nwords * sizeof(int), PROT_READ)) {
         append = "mprotect failed\n";
         status = ERROR;
         goto out;
     }
 
     ptrs[0] = map;
-    size = TWOMEG;
+    size = length;
     cl_res = clEnqueueSVMMigrateMem(clprog.queue, 1, ptrs, &size,
 		    0, 0, NULL, &event);
     if (cl_res != CL_SUCCESS) {
@@ -80,16 +83,21 @@ int main(int argc, char* argv[])
         status = ERROR;
         goto out;
     }
-    for (i = 0; i < clprog.nwords; ++i) {
-        if (clprog.r[i] != -i) {
-            printf("i %u map %d r %d\n", i, ((int *)map)[i], clprog.r[i]); // XXX
-            append = "data compare failed\n";
-            status = ERROR;
-            goto out;
-        }
+    if (verify_linear(clprog.out, clprog.nwords, 0, -1, &i)) {
+        printf("i %zu map %d r %d\n", i, ((int *)map)[i], clprog.out[i]); // XXX
+        append = "data compare failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    res = cl_program_bench(&clprog, argv, "thp", map, NULL, NULL);
+    if (res) {
+        append = "cl program bench failed\n";
+        status = ERROR;
+        goto out;
     }
 
-    mem_unmap(map_orig, 2 * TWOMEG);
+    mem_unmap(map_orig, length + TWOMEG);
 
 out:
     print_status(status, argv, append);
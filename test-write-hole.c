@@ -21,11 +21,12 @@ int main(int argc, char* argv[])
 {
     enum status status = SUCCESS;
     struct cl_program clprog;
+    size_t nwords = parse_nwords(argc, argv, NWORDS);
+    /* First half of the file, rounded down to whole pages. */
+    size_t hole = (nwords / 2) & ~((1UL << 10) - 1);
     char *append = "\n";
     int res, fd;
-    unsigned i;
     void *map;
-    ssize_t len;
 
     /* Create file and initialize its content. */
     fd = open("/tmp/." __FILE__, O_CREAT | O_TRUNC | O_RDWR, S_IRWXU);
@@ -34,23 +35,31 @@ int main(int argc, char* argv[])
         status = ERROR;
         goto out;
     }
-    for (i = 0; i < NWORDS; ++i) {
-        write(fd, &i, sizeof(int));
+    if (file_write_linear(fd, nwords, 0, 1)) {
+        append = "writing file failed\n";
+        status = ERROR;
+        goto out;
     }
     fsync(fd);
-    map = mem_file_map_share(fd, NWORDS * sizeof(int));
+    map = mem_file_map_share(fd, nwords * sizeof(int));
     if (map == NULL) {
         append = "mapping file failed\n";
         status = ERROR;
         goto out;
     }
 
-    res = cl_program_init(&clprog, NWORDS);
+    res = cl_program_init(&clprog, nwords);
     if (res) {
         append = "cl program init failed\n";
         status = ERROR;
         goto out;
     }
+    res = cl_program_select_full(&clprog);
+    if (res) {
+        append = "cl program select failed\n";
+        status = ERROR;
+        goto out;
+    }
 
     /* Check that the GPU can read the mmap file. */
     res = cl_program_run(&clprog, map, NULL, NULL);
@@ -60,7 +69,7 @@ int main(int argc, char* argv[])
         goto out;
     }
 
-    if (madvise(map, (NWORDS / 2) * sizeof(unsigned), MADV_REMOVE)) {
+    if (madvise(map, hole * sizeof(unsigned), MADV_REMOVE)) {
         append = "madvise(MADV_REMOVE) failed\n";
         status = ERROR;
         goto out;
@@ -74,17 +83,22 @@ int main(int argc, char* argv[])
         goto out;
     }
 
-    for (i = 0; i < NWORDS; ++i) {
-        if ((i < NWORDS / 2 && clprog.r[i] != -i) ||
-            (i >= NWORDS / 2 && clprog.r[i] != 0)) {
-            append = "checking file failed\n";
-            status = ERROR;
-            goto out;
-        }
+    if (verify_linear(clprog.out, hole, 0, -1, NULL) ||
+        verify_zero(clprog.out + hole, nwords - hole, NULL)) {
+        append = "checking file failed\n";
+        status = ERROR;
+        goto out;
+    }
+
+    res = cl_program_bench(&clprog, argv, "file-share", map, NULL, NULL);
+    if (res) {
+        append = "cl program bench failed\n";
+        status = ERROR;
+        goto out;
     }
 
     /* Close file, and re-open it and check its content. */
-    mem_unmap(map, NWORDS * sizeof(int));
+    mem_unmap(map, nwords * sizeof(int));
     close(fd);
     fd = open("/tmp/." __FILE__, O_RDWR);
     if (fd < 0) {
@@ -92,17 +106,11 @@ int main(int argc, char* argv[])
         status = ERROR;
         goto out;
     }
-    for (i = 0; i < NWORDS; ++i) {
-        unsigned v;
-
-        len = read(fd, &v, sizeof(int));
-        if (len != sizeof(v) ||
-            (i < NWORDS / 2 && v != 0) ||
-            (i >= NWORDS / 2 && v != i)) {
-            append = "checking file failed\n";
-            status = ERROR;
-            goto out;
-        }
+    if (file_verify_linear(fd, hole, 0, 0) ||
+        file_verify_linear(fd, nwords - hole, hole, 1)) {
+        append = "checking file failed\n";
+        status = ERROR;
+        goto out;
     }
 
 out:
@@ -0,0 +1,228 @@
+/*
+ * Copyright 2018 Red Hat Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+#ifndef SVM_CL_TESTS_VERIFY_H
+#define SVM_CL_TESTS_VERIFY_H
+
+/*
+ * Result verification for large buffers. Every check the tests make is a
+ * linear pattern, word i expected to be base + i * step with 32-bit wrap
+ * around: all zero (0, 0), the a and b inputs (0, 1) and (0, -1), or a
+ * constant (c, 0). Piecewise expectations check each piece separately.
+ *
+ * The compare loop uses AVX2 or SSE2 when the CPU has them, and buffers of
+ * VERIFY_CHUNK words or more are split across threads (one per online CPU,
+ * or SVM_CL_VERIFY_THREADS). The first mismatching index is reported.
+ * fill_linear() generates the same patterns, so inputs never need to be
+ * kept around as reference copies.
+ */
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define VERIFY_X86 1
+#endif
+
+/* 64MiB of int32 per thread at least, below that threads do not pay off. */
+#define VERIFY_CHUNK    (16UL << 20)
+#define VERIFY_THREADS  64
+
+typedef size_t (*verify_fn)(const int32_t *p, size_t start, size_t end,
+                            uint32_t base, uint32_t step);
+
+/* All of these return the first mismatching index in [start, end) or end. */
+static size_t verify_scalar(const int32_t *p, size_t start, size_t end,
+                            uint32_t base, uint32_t step)
+{
+    uint32_t expect = base + (uint32_t)start * step;
+    size_t i;
+
+    for (i = start; i < end; ++i, expect += step) {
+        if ((uint32_t)p[i] != expect) {
+            return i;
+        }
+    }
+    return end;
+}
+
+#ifdef VERIFY_X86
+__attribute__((target("sse2")))
+static size_t verify_sse2(const int32_t *p, size_t start, size_t end,
+                          uint32_t base, uint32_t step)
+{
+    uint32_t e = base + (uint32_t)start * step;
+    __m128i expect = _mm_setr_epi32(e, e + step, e + 2 * step, e + 3 * step);
+    __m128i inc = _mm_set1_epi32(4 * step);
+    __m128i v;
+    size_t i;
+
+    for (i = start; i + 4 <= end; i += 4) {
+        v = _mm_loadu_si128((const __m128i *)(p + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(v, expect)) != 0xffff) {
+            break;
+        }
+        expect = _mm_add_epi32(expect, inc);
+    }
+    /* Tail, or locate the mismatch inside the failing vector. */
+    return verify_scalar(p, i, end, base, step);
+}
+
+__attribute__((target("avx2")))
+static size_t verify_avx2(const int32_t *p, size_t start, size_t end,
+                          uint32_t base, uint32_t step)
+{
+    uint32_t e = base + (uint32_t)start * step;
+    __m256i expect = _mm256_setr_epi32(e, e + step, e + 2 * step,
+                                       e + 3 * step, e + 4 * step,
+                                       e + 5 * step, e + 6 * step,
+                                       e + 7 * step);
+    __m256i inc = _mm256_set1_epi32(8 * step);
+    __m256i v;
+    size_t i;
+
+    for (i = start; i + 8 <= end; i += 8) {
+        v = _mm256_loadu_si256((const __m256i *)(p + i));
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(v, expect)) != -1) {
+            break;
+        }
+        expect = _mm256_add_epi32(expect, inc);
+    }
+    return verify_scalar(p, i, end, base, step);
+}
+#endif
+
+static verify_fn verify_select(void)
+{
+    static verify_fn fn;
+
+    if (fn) {
+        return fn;
+    }
+    fn = verify_scalar;
+#ifdef VERIFY_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        fn = verify_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        fn = verify_sse2;
+    }
+#endif
+    return fn;
+}
+
+static unsigned verify_nthreads(size_t n)
+{
+    const char *env = getenv("SVM_CL_VERIFY_THREADS");
+    long nthreads;
+
+    nthreads = env ? strtol(env, NULL, 0) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads > (long)(n / VERIFY_CHUNK)) {
+        nthreads = n / VERIFY_CHUNK;
+    }
+    if (nthreads > VERIFY_THREADS) {
+        nthreads = VERIFY_THREADS;
+    }
+    return nthreads > 1 ? nthreads : 1;
+}
+
+struct verify_range {
+    pthread_t thread;
+    int spawned;
+    verify_fn fn;
+    const int32_t *p;
+    size_t start;
+    size_t end;
+    uint32_t base;
+    uint32_t step;
+    size_t bad;
+};
+
+static void *verify_thread(void *arg)
+{
+    struct verify_range *range = arg;
+
+    range->bad = range->fn(range->p, range->start, range->end,
+                           range->base, range->step);
+    return NULL;
+}
+
+/*
+ * Check that word i of the n words at ptr is base + i * step. Returns 0 on
+ * success, -1 on mismatch with the first bad index stored in *bad (if not
+ * NULL).
+ */
+static int verify_linear(const void *ptr, size_t n, int32_t base,
+                         int32_t step, size_t *bad)
+{
+    struct verify_range ranges[VERIFY_THREADS];
+    unsigned i, nthreads = verify_nthreads(n);
+    verify_fn fn = verify_select();
+    size_t first = n;
+
+    if (nthreads == 1) {
+        first = fn(ptr, 0, n, base, step);
+    } else {
+        for (i = 0; i < nthreads; ++i) {
+            ranges[i].fn = fn;
+            ranges[i].p = ptr;
+            ranges[i].start = n / nthreads * i;
+            ranges[i].end = i == nthreads - 1 ? n : n / nthreads * (i + 1);
+            ranges[i].base = base;
+            ranges[i].step = step;
+            ranges[i].spawned = i && !pthread_create(&ranges[i].thread, NULL,
+                                                     verify_thread,
+                                                     &ranges[i]);
+            if (i && !ranges[i].spawned) {
+                /* Could not spawn, check it from this thread. */
+                verify_thread(&ranges[i]);
+            }
+        }
+        verify_thread(&ranges[0]);
+        for (i = 0; i < nthreads; ++i) {
+            if (ranges[i].spawned) {
+                pthread_join(ranges[i].thread, NULL);
+            }
+            if (first == n && ranges[i].bad < ranges[i].end) {
+                first = ranges[i].bad;
+            }
+        }
+    }
+
+    if (first < n) {
+        if (bad) {
+            *bad = first;
+        }
+        return -1;
+    }
+    return 0;
+}
+
+static int verify_zero(const void *ptr, size_t n, size_t *bad)
+{
+    return verify_linear(ptr, n, 0, 0, bad);
+}
+
+/* Write the pattern verify_linear() checks for, word i = base + i * step. */
+static void fill_linear(void *ptr, size_t n, int32_t base, int32_t step)
+{
+    uint32_t *p = ptr, v = base;
+    size_t i;
+
+    for (i = 0; i < n; ++i, v += step) {
+        p[i] = v;
+    }
+}
+
+#endif /* SVM_CL_TESTS_VERIFY_H */